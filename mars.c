@@ -31,6 +31,16 @@
 #include <asm/irq.h>
 #include <linux/uaccess.h>
 #include <linux/version.h>
+#include <linux/ktime.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
+#include <linux/jump_label.h>
+#include <linux/log2.h>
+#include <linux/math64.h>
+#include <linux/list.h>
+#include <linux/workqueue.h>
+#include <linux/wait.h>
+#include <linux/sched.h>
 
  /* Mask used for ID comparisons */
 #define CTC_PHY_ID_MASK             0xffffffff
@@ -46,18 +56,53 @@
 #define CTC_PHY_IMASK_INIT              0x6c00
 #define CTC_PHY_IMASK_CLEAR             0x0000
 
+/* Interrupt event bits */
+#define CTC_PHY_IEVENT_SPEED_CHG        BIT(14)
+#define CTC_PHY_IEVENT_DUPLEX_CHG       BIT(13)
+#define CTC_PHY_IEVENT_LINK_DOWN        BIT(11)
+#define CTC_PHY_IEVENT_LINK_UP          BIT(10)
+#define CTC_PHY_IEVENT_WOL              BIT(6)
+/* Events the state machine has to act on */
+#define CTC_PHY_IEVENT_LINK_MASK \
+	(CTC_PHY_IEVENT_SPEED_CHG | CTC_PHY_IEVENT_DUPLEX_CHG | \
+	 CTC_PHY_IEVENT_LINK_DOWN | CTC_PHY_IEVENT_LINK_UP)
+
 #define CTC_PHY_REG_SPACE                    0
 #define CTC_SDS_REG_SPACE                    1
+/* Register space shadow not valid, read it back from hardware */
+#define CTC_REG_SPACE_UNKNOWN               -1
 
 /* Mars page register */
 #define CTC_MARS_PAGE_REG               0xa000
 #define CTC_MARS_CHIP_CFG_REG           0xa001
+/* RGMII RX clock delay of about 1.9 ns */
+#define CTC_MARS_CHIP_CFG_RXC_DLY_EN    BIT(8)
+#define CTC_MARS_RXC_DLY_PS               1900
+/* RGMII delay lines, in CTC_MARS_RGMII_DLY_STEP_PS steps */
+#define CTC_MARS_RGMII_CFG1_REG         0xa003
+#define CTC_MARS_RGMII_RX_DLY_SHIFT         10
+#define CTC_MARS_RGMII_FE_TX_DLY_SHIFT       4
+#define CTC_MARS_RGMII_DLY_MASK         0x3cff
+#define CTC_MARS_RGMII_DLY_STEP_PS         150
+#define CTC_MARS_RGMII_DLY_MAX              15
+/* Delay of an rgmii-*id side without *-internal-delay-ps */
+#define CTC_MARS_RGMII_DLY_DEF_PS         1950
 
 #define CTC_PHY_GLB_DISABLE                  0
 #define CTC_PHY_GLB_ENABLE                   1
 
 /* Mars specific status register */
 #define CTC_MARS_SSREG                    0x11
+#define CTC_MARS_SSREG_SPEED_1000       BIT(15)
+#define CTC_MARS_SSREG_SPEED_100        BIT(14)
+#define CTC_MARS_SSREG_DUPLEX_FULL      BIT(13)
+/* Speed and duplex resolved */
+#define CTC_MARS_SSREG_RESOLVED         BIT(11)
+/* Real time link status, not latched */
+#define CTC_MARS_SSREG_LINK             BIT(10)
+#define CTC_MARS_SSREG_MODE_MASK \
+	(CTC_MARS_SSREG_SPEED_1000 | CTC_MARS_SSREG_SPEED_100 | \
+	 CTC_MARS_SSREG_DUPLEX_FULL)
 
 /* Interrupt Enable Register */
 #define CTC_MARS_INTR_REG                 0x12
@@ -78,8 +123,48 @@
 /* WOL Pulse Width */
 #define CTC_MARS_WOL_WIDTH1             BIT(1)
 #define CTC_MARS_WOL_WIDTH2             BIT(2)
-/* WOL Enable Flag: disable by default */
-// #define CTC_MARS_WOL_ENABLE
+/* Packet checker, UTP extended space */
+#define CTC_MARS_PKG_CFG0_REG             0xa0
+/* Packet checker enable */
+#define CTC_MARS_PKG_CHK_EN             BIT(14)
+/* Packet generator enable and payload pattern */
+#define CTC_MARS_PKG_GEN_EN             BIT(13)
+#define CTC_MARS_PKG_PATTERN_SHIFT          10
+#define CTC_MARS_PKG_PATTERN_MASK       0x0c00
+/* Generated frame length in bytes */
+#define CTC_MARS_PKG_CFG1_REG             0xa1
+#define CTC_MARS_PKG_LEN_MIN                64
+#define CTC_MARS_PKG_LEN_MAX              1518
+/* Frames per run, 0 for continuous */
+#define CTC_MARS_PKG_CFG2_REG             0xa2
+/* Free running checker counters, good frames split in two halves */
+#define CTC_MARS_PKG_RX_GOOD_HI           0xa3
+#define CTC_MARS_PKG_RX_GOOD_LO           0xa4
+#define CTC_MARS_PKG_RX_ERR               0xa7
+#define CTC_MARS_PKG_TX_GOOD_HI           0xab
+#define CTC_MARS_PKG_TX_GOOD_LO           0xac
+#define CTC_MARS_PKG_TX_ERR               0xad
+/* LPI entry timer, UTP extended space, in us */
+#define CTC_MARS_LPI_TIMER_REG            0x57
+/* Copper fast link down, UTP extended space */
+#define CTC_MARS_FLD_CFG_REG              0x4a
+#define CTC_MARS_FLD_EN                 BIT(15)
+#define CTC_MARS_FLD_DELAY_MASK         0x0003
+/* Copper smart speed (downshift), UTP extended space */
+#define CTC_MARS_SMART_SPEED_REG          0x20
+#define CTC_MARS_SMART_SPEED_EN         BIT(3)
+/* Gigabit attempts before the downshift, minus one */
+#define CTC_MARS_SMART_SPEED_RETRY_SHIFT     4
+#define CTC_MARS_SMART_SPEED_RETRY_MASK 0x0070
+#define CTC_MARS_SMART_SPEED_MASK \
+	(CTC_MARS_SMART_SPEED_EN | CTC_MARS_SMART_SPEED_RETRY_MASK)
+#define CTC_MARS_DOWNSHIFT_MAX_COUNT         8
+#define CTC_MARS_DOWNSHIFT_DEF_COUNT         3
+/* SerDes link timer, SDS extended space, in 520 us units */
+#define CTC_MARS_SDS_LINK_TIMER_REG       0xa5
+#define CTC_MARS_SDS_LINK_TIMER_UNIT_US    520
+/* 2.6ms */
+#define CTC_MARS_SDS_LINK_TIMER_DEF        0x5
 
 enum mars_port_type_e {
 	MARS_PORT_TYPE_UTP,
@@ -88,6 +173,26 @@ enum mars_port_type_e {
 	MARS_PORT_TYPE_MAX
 };
 
+/* Media a combo port may link on and the one probed first */
+enum mars_medium_policy_e {
+	MARS_MEDIUM_AUTO,
+	MARS_MEDIUM_PREFER_FIBER,
+	MARS_MEDIUM_PREFER_COPPER,
+	MARS_MEDIUM_FIBER_ONLY,
+	MARS_MEDIUM_COPPER_ONLY,
+	MARS_MEDIUM_POLICY_MAX
+};
+
+/* Polling regime of a PHY without interrupt */
+enum mars_poll_mode_e {
+	/* Link changed or negotiation restarted recently */
+	MARS_POLL_FAST,
+	MARS_POLL_NORMAL,
+	/* No change for poll_stable_s, polls check the status register */
+	MARS_POLL_STABLE,
+	MARS_POLL_MODE_MAX
+};
+
 enum mars_wol_type_e {
 	MARS_WOL_TYPE_LEVEL,
 	MARS_WOL_TYPE_PULSE,
@@ -108,696 +213,4222 @@ struct mars_wol_cfg_t {
 	int width;
 };
 
-static int mars_ext_read(struct phy_device *phydev, u32 regnum)
-{
-	int ret;
+enum mars_reg_type_e {
+	MARS_REG_TYPE_STD,
+	MARS_REG_TYPE_EXT,
+	MARS_REG_TYPE_MMD,
+	MARS_REG_TYPE_MAX
+};
 
-	ret = phy_write(phydev, 0x1e, regnum);
-	if (ret < 0)
-		return ret;
+/* One step of a register sequence: update the bits of mask with val */
+struct mars_reg_seq_t {
+	u8 space;
+	u8 type;
+	u8 devad;
+	u16 reg;
+	u16 mask;
+	u16 val;
+};
 
-	return phy_read(phydev, 0x1f);
-}
+#define MARS_SEQ_STD(_space, _reg, _mask, _val) \
+	{ _space, MARS_REG_TYPE_STD, 0, _reg, _mask, _val }
+#define MARS_SEQ_EXT(_space, _reg, _mask, _val) \
+	{ _space, MARS_REG_TYPE_EXT, 0, _reg, _mask, _val }
+#define MARS_SEQ_MMD(_space, _devad, _reg, _mask, _val) \
+	{ _space, MARS_REG_TYPE_MMD, _devad, _reg, _mask, _val }
+
+/* Chip specific sequence applied by config_init */
+struct mars_chip_seq_t {
+	u32 phy_id;
+	const struct mars_reg_seq_t *seq;
+	int count;
+};
 
-static int mars_ext_write(struct phy_device *phydev, u32 regnum, u16 val)
-{
-	int ret;
+/* Polls between probes of the idle combo medium while no link is up */
+#define MARS_IDLE_PROBE_POLLS                4
+
+/* Board SerDes settings accepted from ctc,serdes-tuning */
+#define MARS_SDS_TUNING_MAX                  4
+
+/* Longest sequence the executor can unwind */
+#define MARS_REG_SEQ_MAX                    32
+
+/* Registers kept across suspend, see mars_pm_regs */
+enum mars_pm_reg_e {
+	MARS_PM_ADVERTISE,
+	MARS_PM_CTRL1000,
+	MARS_PM_SDS_ADVERTISE,
+	MARS_PM_IMASK,
+	MARS_PM_WOL_CFG,
+	MARS_PM_LINK_TIMER,
+	MARS_PM_FLD_CFG,
+	MARS_PM_SMART_SPEED,
+	MARS_PM_REG_MAX
+};
 
-	ret = phy_write(phydev, 0x1e, regnum);
-	if (ret < 0)
-		return ret;
+/* Packet checker and EEE counters, see mars_hw_stat_regs */
+enum mars_hw_stat_reg_e {
+	/* EEE state, latched LPI bits and the clear on read wake counter */
+	MARS_HW_PCS_STAT1,
+	MARS_HW_EEE_WAKE_ERR,
+	MARS_HW_RX_ERR,
+	MARS_HW_TX_ERR,
+	/* Good frame counters, from here on the registers can be read again */
+	MARS_HW_RX_GOOD_HI,
+	MARS_HW_RX_GOOD_LO,
+	MARS_HW_TX_GOOD_HI,
+	MARS_HW_TX_GOOD_LO,
+	/* High halves read again after the low ones to catch a carry */
+	MARS_HW_RX_GOOD_HI2,
+	MARS_HW_TX_GOOD_HI2,
+	MARS_HW_STAT_REG_MAX
+};
 
-	return phy_write(phydev, 0x1f, val);
-}
+/* Minimum interval between two hardware counter reads */
+#define MARS_HW_STATS_MIN_MS               500
+/* Good frame counter reads before giving up on one that keeps carrying */
+#define MARS_HW_STATS_TRIES                  3
+/* Leading mars_stat_descs entries fed by the copper packet checker */
+#define MARS_HW_STAT_DESCS                   4
+
+/* MDIO frame classes for the debugfs accounting */
+enum mars_frame_e {
+	MARS_FRAME_STD,
+	MARS_FRAME_EXT,
+	MARS_FRAME_PAGE,
+	MARS_FRAME_MAX
+};
 
-static int mars_select_reg_space(struct phy_device *phydev, int space)
-{
-	int ret;
+/* Driver callbacks covered by the debugfs accounting */
+enum mars_cb_e {
+	MARS_CB_READ_STATUS,
+	MARS_CB_CONFIG_ANEG,
+	MARS_CB_CONFIG_INIT,
+	MARS_CB_SET_WOL,
+	MARS_CB_MAX
+};
 
-	if (space == CTC_PHY_REG_SPACE)
-		ret = mars_ext_write(phydev, 0xa000, 0x0);
-	else
-		ret = mars_ext_write(phydev, 0xa000, 0x2);
+/* Latency histogram buckets, bucket n counts calls under 2^n us */
+#define MARS_ACCT_BUCKETS                  16
 
-	return ret;
-}
+#if defined(CONFIG_DEBUG_FS) && \
+	(LINUX_VERSION_CODE >= KERNEL_VERSION(4, 16, 0))
+#define MARS_DEBUGFS
+#endif
 
-static int mars_page_read(struct phy_device *phydev, int page, u32 regnum)
-{
-	int ret, oldpage, val;
+struct mars_acct_t {
+	u64 calls;
+	u64 frames[MARS_FRAME_MAX];
+	u64 hist[MARS_ACCT_BUCKETS];
+	/* Largest frame count of a single call */
+	unsigned int max_frames;
+};
 
-	oldpage = mars_ext_read(phydev, CTC_MARS_PAGE_REG);
-	if (oldpage < 0)
-		return oldpage;
+/* Register shadow value not known */
+#define MARS_SHADOW_UNKNOWN                 -1
 
-	ret = mars_select_reg_space(phydev, page);
-	if (ret < 0)
-		return ret;
+/* phylib routes all its MMD accesses through .read_mmd/.write_mmd with the
+ * bus lock held, so the latched MMD address can be trusted.
+ */
+#if (LINUX_VERSION_CODE >= KERNEL_VERSION(5, 0, 0))
+#define MARS_MMD_OPS
+#endif
 
-	val = phy_read(phydev, regnum);
-	/* Recover to old page */
-	ret = mars_select_reg_space(phydev, (oldpage & 0x2));
-	if (ret < 0)
-		return ret;
+struct mars_stats_t {
+	/* Packet checker totals */
+	u64 rx_good;
+	u64 rx_err;
+	u64 tx_good;
+	u64 tx_err;
+	/* MDIO frames issued by the driver */
+	u64 mdio_ops;
+	u64 page_switches;
+	/* Selector accesses skipped thanks to the register space shadow */
+	u64 reg_space_saved;
+	u64 link_flaps;
+	u64 medium_switches;
+	u64 interrupts;
+	/* Decoded interrupt events */
+	u64 irq_link_up;
+	u64 irq_link_down;
+	u64 irq_speed_chg;
+	u64 irq_wol;
+	/* Probe to end of the first hardware init */
+	u64 bringup_us;
+	/* Counter reads that found LPI indicated since the previous one */
+	u64 eee_rx_lpi;
+	u64 eee_tx_lpi;
+	u64 eee_wake_err;
+	/* Copper links that came up below gigabit after a downshift */
+	u64 downshifts;
+	/* Interrupt storms, interrupts in the last full one second window */
+	u64 irq_storms;
+	u64 irq_rate;
+	/* Flap damping: figure at the last status read, link held down */
+	u64 flap_penalty;
+	u64 flap_suppressed;
+	u64 flap_suppressions;
+	u64 flap_held_ups;
+};
 
-	return val;
+/* ethtool statistic, offset of the counter in struct mars_stats_t */
+struct mars_stat_desc_t {
+	const char *name;
+	unsigned int offset;
+};
+
+#define MARS_STAT(_name, _field) \
+	{ _name, offsetof(struct mars_stats_t, _field) }
+
+/* Callbacks specialized for one port type, bound at probe time */
+struct mars_port_ops_t {
+	int (*config_aneg)(struct phy_device *phydev);
+	int (*read_status)(struct phy_device *phydev);
+};
+
+/* Link flap damping. Every link down adds penalty to a figure that halves
+ * every half_life_ms. Link up is held back from the figure reaching
+ * suppress until it decays below reuse, link down is always reported.
+ * A zero penalty disables damping.
+ */
+struct mars_damp_t {
+	u32 penalty;
+	u32 half_life_ms;
+	u32 suppress;
+	u32 reuse;
+	u32 figure;
+	unsigned long stamp;
+	bool suppressed;
+	/* Link as last read from the hardware, phydev->link may be held */
+	bool raw_link;
+};
+
+/* Link state as last reported to phylib, read without the MDIO bus */
+struct mars_snapshot_t {
+	/* Status reads since probe, and the monotonic time of the last */
+	u64 generation;
+	s64 timestamp_ns;
+	int link;
+	int speed;
+	int duplex;
+	int port;
+	int pause;
+	int asym_pause;
+};
+
+/* Deferred hardware init of the MARS PHYs on one MDIO bus. A single work
+ * item initializes the PHYs of a bus one after the other, different buses
+ * run concurrently.
+ */
+struct mars_bus_init_t {
+	struct list_head node;
+	struct mii_bus *bus;
+	struct work_struct work;
+	/* PHYs waiting for their deferred init */
+	struct list_head pending;
+	/* PHY being initialized by the work item, idle is woken when it
+	 * is done
+	 */
+	struct mars_priv *running;
+	wait_queue_head_t idle;
+	int users;
+};
+
+/* Per-PHY state, allocated at probe time */
+struct mars_priv {
+	struct phy_device *phydev;
+	int port_type;
+	const struct mars_port_ops_t *ops;
+	/* Shadow copy of the register space selected in CTC_MARS_PAGE_REG */
+	int reg_space;
+	/* MMD address latched in the UTP space MII_MMD_CTRL/MII_MMD_DATA */
+	int mmd_devad;
+	int mmd_reg;
+	/* EEE settings restored after a reset, MARS_SHADOW_UNKNOWN when the
+	 * hardware default is kept
+	 */
+	int eee_adv;
+	int lpi_timer;
+	/* Fast link down, CTC_MARS_FLD_CFG_REG and the SerDes link timer */
+	int fld_cfg;
+	int link_timer;
+	/* Downshift bits of CTC_MARS_SMART_SPEED_REG */
+	int smart_speed;
+	/* rx/tx-internal-delay-ps, -1 when absent */
+	int rx_delay_ps;
+	int tx_delay_ps;
+	/* ctc,serdes-tuning <reg mask val> triplets, SDS extended space */
+	u16 sds_tuning[MARS_SDS_TUNING_MAX][3];
+	int sds_tuning_n;
+	/* Events unmasked while interrupts are enabled */
+	u16 irq_events;
+	/* Last value written to CTC_PHY_IMASK */
+	int imask;
+	bool irq_enabled;
+	bool wol_irq;
+	/* WOL restored after a reset, and the output it drives */
+	u32 wolopts;
+	int wol_type;
+	int wol_width;
+	/* Last values written to CTC_MARS_WOL_CFG_REG and the magic packet
+	 * address registers
+	 */
+	int wol_cfg;
+	int wol_mac[3];
+	/* Interrupt storm: link events masked and polled from irq_work. The
+	 * handler, irq_work and config_intr update the state under irq_lock,
+	 * a throttled PHY always has irq_work queued or running.
+	 */
+	spinlock_t irq_lock;
+	bool irq_throttled;
+	unsigned int irq_calm_polls;
+	unsigned long irq_window;
+	unsigned int irq_window_count;
+	struct delayed_work irq_work;
+	struct mars_damp_t damp;
+	/* Polls a held link in interrupt mode, when no poll would come */
+	struct delayed_work damp_work;
+	seqlock_t snap_lock;
+	struct mars_snapshot_t snap;
+	/* Adaptive polling: last change, last full status read and the
+	 * CTC_MARS_SSREG it returned for a link up
+	 */
+	unsigned long poll_change;
+	unsigned long poll_full;
+	int ssreg_last;
+	struct delayed_work poll_work;
+	/* Combo port medium that had the link last, probed first in auto */
+	int active_medium;
+	int medium_policy;
+	/* Speed and duplex bits of CTC_MARS_SSREG for the reported link */
+	int link_mode;
+	/* Link held down for one read after a failover changed speed */
+	bool medium_relink;
+	/* Space in loopback, CTC_REG_SPACE_UNKNOWN when none, and its BMCR
+	 * from before the loopback
+	 */
+	int loopback_space;
+	int loopback_bmcr;
+	/* Polls since the idle medium was last probed */
+	unsigned int idle_polls;
+	/* Last values programmed by the driver, BMCR per register space */
+	int bmcr[2];
+	int advertise;
+	int ctrl1000;
+	/* Supported modes found by the first config_init */
+	u32 features;
+	bool features_valid;
+	/* Register snapshot taken at suspend */
+	u16 pm_regs[MARS_PM_REG_MAX];
+	bool pm_valid;
+	/* Packet checker enabled, its values at the last read */
+	bool pkg_chk;
+	u16 hw_stats_last[MARS_HW_STAT_REG_MAX];
+	bool hw_stats_valid;
+	unsigned long hw_stats_jiffies;
+	struct mars_stats_t stats;
+	/* Deferred init, queued on bus_init until init_node is empty */
+	struct mars_bus_init_t *bus_init;
+	struct list_head init_node;
+	ktime_t probe_time;
+#ifdef MARS_DEBUGFS
+	/* Task running the callback being accounted, NULL when none. Only
+	 * the owner touches acct_cb, acct_frames and acct[].
+	 */
+	struct task_struct *acct_owner;
+	int acct_cb;
+	unsigned int acct_frames;
+	struct mars_acct_t acct[MARS_CB_MAX];
+	struct dentry *debugfs;
+	/* Packet generator settings, used by the next start */
+	u32 pkg_len;
+	u32 pkg_count;
+	u32 pkg_pattern;
+#endif
+};
+
+#if (LINUX_VERSION_CODE >= KERNEL_VERSION(4, 5, 0))
+#define mars_dev(phydev)	(&(phydev)->mdio.dev)
+#define mars_bus(phydev)	((phydev)->mdio.bus)
+#else
+#define mars_dev(phydev)	(&(phydev)->dev)
+#define mars_bus(phydev)	((phydev)->bus)
+#endif
+
+#if (LINUX_VERSION_CODE < KERNEL_VERSION(4, 18, 0))
+/* No paged access support: fall back to the self-locking accessors, the
+ * bus lock is then only held per MDIO frame.
+ */
+#define __phy_read(phydev, regnum)		phy_read(phydev, regnum)
+#define __phy_write(phydev, regnum, val)	phy_write(phydev, regnum, val)
+#define phy_lock_mdio_bus(phydev)		do { } while (0)
+#define phy_unlock_mdio_bus(phydev)		do { } while (0)
+#elif (LINUX_VERSION_CODE < KERNEL_VERSION(5, 5, 0))
+#define phy_lock_mdio_bus(phydev)	mutex_lock(&(phydev)->mdio.bus->mdio_lock)
+#define phy_unlock_mdio_bus(phydev)	mutex_unlock(&(phydev)->mdio.bus->mdio_lock)
+#endif
+
+#if (LINUX_VERSION_CODE < KERNEL_VERSION(4, 16, 0))
+/* Older phy_trigger_machine() took a sync flag, kick the queue directly */
+#define phy_trigger_machine(phydev) \
+	mod_delayed_work(system_power_efficient_wq, &(phydev)->state_queue, 0)
+#endif
+
+#if (LINUX_VERSION_CODE < KERNEL_VERSION(4, 15, 0))
+#define mul_u32_u32(a, b)	((u64)(u32)(a) * (u32)(b))
+#endif
+
+#ifndef ETHTOOL_PHY_FAST_LINK_DOWN_OFF
+#define ETHTOOL_PHY_FAST_LINK_DOWN_OFF	0xff
+#endif
+
+/* The KUnit module builds this file with the tracepoints compiled out */
+#ifndef MARS_KUNIT
+#define CREATE_TRACE_POINTS
+#endif
+#include "mars_trace.h"
+
+#ifdef MARS_DEBUGFS
+static bool debugfs;
+module_param(debugfs, bool, 0444);
+MODULE_PARM_DESC(debugfs, "Per-PHY debugfs MDIO accounting (default: off)");
+
+static bool debugfs_regs;
+module_param(debugfs_regs, bool, 0444);
+MODULE_PARM_DESC(debugfs_regs,
+		 "Per-PHY debugfs register dump, without the accounting (default: off)");
+
+static DEFINE_STATIC_KEY_FALSE(mars_acct_enabled);
+static DEFINE_MUTEX(mars_debugfs_lock);
+static struct dentry *mars_debugfs_root;
+static int mars_debugfs_users;
+
+static const char * const mars_cb_names[MARS_CB_MAX] = {
+	[MARS_CB_READ_STATUS] = "read_status",
+	[MARS_CB_CONFIG_ANEG] = "config_aneg",
+	[MARS_CB_CONFIG_INIT] = "config_init",
+	[MARS_CB_SET_WOL] = "set_wol",
+};
+#endif
+
+static void mars_acct_frame(struct phy_device *phydev, int frame)
+{
+	struct mars_priv *priv = phydev->priv;
+
+	priv->stats.mdio_ops++;
+#ifdef MARS_DEBUGFS
+	if (static_branch_unlikely(&mars_acct_enabled) &&
+	    READ_ONCE(priv->acct_owner) == current) {
+		priv->acct[priv->acct_cb].frames[frame]++;
+		priv->acct_frames++;
+	}
+#endif
 }
 
-static int mars_page_write(struct phy_device *phydev, int page, u32 regnum,
-			   u16 value)
+/* Start accounting a callback, nested callbacks are charged to the outer
+ * one. A callback racing with one already accounted from another context
+ * goes unaccounted, and so do its frames. Returns false when there is
+ * nothing to account.
+ */
+static bool mars_acct_begin(struct phy_device *phydev, int cb, ktime_t *start)
 {
-	int ret, oldpage, val;
+#ifdef MARS_DEBUGFS
+	struct mars_priv *priv = phydev->priv;
+
+	if (static_branch_unlikely(&mars_acct_enabled) &&
+	    !cmpxchg(&priv->acct_owner, NULL, current)) {
+		priv->acct_cb = cb;
+		priv->acct_frames = 0;
+		*start = ktime_get();
+		return true;
+	}
+#endif
+	return false;
+}
 
-	oldpage = mars_ext_read(phydev, CTC_MARS_PAGE_REG);
-	if (oldpage < 0)
-		return oldpage;
+static void mars_acct_end(struct phy_device *phydev, int cb, ktime_t start)
+{
+#ifdef MARS_DEBUGFS
+	struct mars_priv *priv = phydev->priv;
+	struct mars_acct_t *acct = &priv->acct[cb];
+	s64 us = ktime_us_delta(ktime_get(), start);
+	int bucket = 0;
+
+	if (us > 0)
+		bucket = min_t(int, ilog2(us) + 1, MARS_ACCT_BUCKETS - 1);
+
+	acct->calls++;
+	acct->hist[bucket]++;
+	acct->max_frames = max(acct->max_frames, priv->acct_frames);
+	smp_store_release(&priv->acct_owner, NULL);
+#endif
+}
 
-	ret = mars_select_reg_space(phydev, page);
-	if (ret < 0)
-		return ret;
+/* Raw MDIO access, the caller must hold the MDIO bus lock. Driver register
+ * traffic goes through here so that it can be accounted.
+ */
+static int __mars_mdio_read(struct phy_device *phydev, u32 regnum, int frame)
+{
+	mars_acct_frame(phydev, frame);
+	return __phy_read(phydev, regnum);
+}
 
-	val = phy_write(phydev, regnum, value);
-	/* Recover to old page */
-	ret = mars_select_reg_space(phydev, (oldpage & 0x2));
-	if (ret < 0)
-		return ret;
+static int __mars_mdio_write(struct phy_device *phydev, u32 regnum, u16 val,
+			     int frame)
+{
+	mars_acct_frame(phydev, frame);
+	return __phy_write(phydev, regnum, val);
+}
 
-	return val;
+/* Register accesses are traced with their latency, the clock is only
+ * read while the event is enabled.
+ */
+static u64 mars_trace_clock(bool enabled)
+{
+	return enabled ? ktime_get_ns() : 0;
 }
 
-static int mars_page_ext_write(struct phy_device *phydev, int page, u32 regnum,
-			       u16 value)
+static int mars_trace_space(struct phy_device *phydev)
 {
-	int ret, oldpage, val;
+	struct mars_priv *priv = phydev->priv;
 
-	oldpage = mars_ext_read(phydev, CTC_MARS_PAGE_REG);
-	if (oldpage < 0)
-		return oldpage;
+	return priv->reg_space;
+}
 
-	ret = mars_select_reg_space(phydev, page);
-	if (ret < 0)
-		return ret;
+static int __mars_read(struct phy_device *phydev, u32 regnum)
+{
+	u64 start = mars_trace_clock(trace_mars_reg_read_enabled());
+	int ret;
 
-	val = mars_ext_write(phydev, regnum, value);
-	/* Recover to old page */
-	ret = mars_select_reg_space(phydev, (oldpage & 0x2));
-	if (ret < 0)
-		return ret;
+	ret = __mars_mdio_read(phydev, regnum, MARS_FRAME_STD);
+	trace_mars_reg_read(phydev, MARS_FRAME_STD, mars_trace_space(phydev),
+			    regnum, ret, start);
 
-	return val;
+	return ret;
 }
 
-static int mars_setup_forced(struct phy_device *phydev)
+static int __mars_write(struct phy_device *phydev, u32 regnum, u16 val)
 {
-	int ctl = 0;
-	int ret = 0;
-	int port_type = 0;
+	u64 start = mars_trace_clock(trace_mars_reg_write_enabled());
+	int ret;
 
-	port_type = *(int*)phydev->priv;
-	if (port_type == MARS_PORT_TYPE_UTP ||
-	    port_type == MARS_PORT_TYPE_COMBO) {
-		ctl = mars_page_read(phydev, CTC_PHY_REG_SPACE, MII_BMCR);
-		if (ctl < 0)
-			return ctl;
-		ctl &= BMCR_LOOPBACK | BMCR_ISOLATE | BMCR_PDOWN;
-		phydev->pause = 0;
-		phydev->asym_pause = 0;
+	ret = __mars_mdio_write(phydev, regnum, val, MARS_FRAME_STD);
+	trace_mars_reg_write(phydev, MARS_FRAME_STD, mars_trace_space(phydev),
+			     regnum, ret < 0 ? ret : val, start);
 
-		if (phydev->speed == SPEED_1000)
-			ctl |= BMCR_SPEED1000;
-		else if (phydev->speed == SPEED_100)
-			ctl |= BMCR_SPEED100;
+	return ret;
+}
 
-		if (phydev->duplex == DUPLEX_FULL)
-			ctl |= BMCR_FULLDPLX;
+/* Extended register access, the caller must hold the MDIO bus lock */
+static int __mars_ext_read_as(struct phy_device *phydev, u32 regnum,
+			      int frame)
+{
+	u64 start = mars_trace_clock(trace_mars_reg_read_enabled());
+	int ret;
 
-		ret = mars_page_write(phydev, CTC_PHY_REG_SPACE, MII_BMCR, ctl);
-		if (ret < 0)
-			return ret;
-	}
+	ret = __mars_mdio_write(phydev, 0x1e, regnum, frame);
+	if (ret >= 0)
+		ret = __mars_mdio_read(phydev, 0x1f, frame);
+	trace_mars_reg_read(phydev, frame, mars_trace_space(phydev), regnum,
+			    ret, start);
 
-	if (port_type == MARS_PORT_TYPE_FIBER ||
-	    port_type == MARS_PORT_TYPE_COMBO) {
-		ctl = mars_page_read(phydev, CTC_SDS_REG_SPACE, MII_BMCR);
-		if (ctl < 0)
-			return ctl;
-		ctl &= ~BMCR_ANENABLE;
-		ret = mars_page_write(phydev, CTC_SDS_REG_SPACE, MII_BMCR, ctl);
-		if (ret < 0)
-			return ret;
-	}
-	return 0;
+	return ret;
 }
 
-static int mars_restart_aneg(struct phy_device *phydev)
+static int __mars_ext_write_as(struct phy_device *phydev, u32 regnum,
+			       u16 val, int frame)
 {
-	int ctl = 0;
-	int ret = 0;
-	int port_type = 0;
+	u64 start = mars_trace_clock(trace_mars_reg_write_enabled());
+	int ret;
 
-	port_type = *(int*)phydev->priv;
+	ret = __mars_mdio_write(phydev, 0x1e, regnum, frame);
+	if (ret >= 0)
+		ret = __mars_mdio_write(phydev, 0x1f, val, frame);
+	trace_mars_reg_write(phydev, frame, mars_trace_space(phydev), regnum,
+			     ret < 0 ? ret : val, start);
 
-	if (port_type == MARS_PORT_TYPE_UTP ||
-	    port_type == MARS_PORT_TYPE_COMBO) {
-		ctl = mars_page_read(phydev, CTC_PHY_REG_SPACE, MII_BMCR);
+	return ret;
+}
 
-		if (ctl < 0)
-			return ctl;
+static int __mars_ext_read(struct phy_device *phydev, u32 regnum)
+{
+	return __mars_ext_read_as(phydev, regnum, MARS_FRAME_EXT);
+}
 
-		ctl |= BMCR_ANENABLE | BMCR_ANRESTART;
+static int __mars_ext_write(struct phy_device *phydev, u32 regnum, u16 val)
+{
+	return __mars_ext_write_as(phydev, regnum, val, MARS_FRAME_EXT);
+}
 
-		/* Don't isolate the PHY if we're negotiating */
-		ctl &= ~BMCR_ISOLATE;
+/* Write regnum while a read left its address latched, data frame only */
+static int __mars_ext_write_latched(struct phy_device *phydev, u32 regnum,
+				    u16 val)
+{
+	u64 start = mars_trace_clock(trace_mars_reg_write_enabled());
+	int ret;
 
-		ret = mars_page_write(phydev, CTC_PHY_REG_SPACE, MII_BMCR, ctl);
-		if (ret < 0)
-			return ret;
-	}
+	ret = __mars_mdio_write(phydev, 0x1f, val, MARS_FRAME_EXT);
+	trace_mars_reg_write(phydev, MARS_FRAME_EXT, mars_trace_space(phydev),
+			     regnum, ret < 0 ? ret : val, start);
 
-	if (port_type == MARS_PORT_TYPE_FIBER ||
-	    port_type == MARS_PORT_TYPE_COMBO) {
-		ctl = mars_page_read(phydev, CTC_SDS_REG_SPACE, MII_BMCR);
-		if (ctl < 0)
-			return ctl;
-		ctl |= BMCR_ANENABLE;
-		ret = mars_page_write(phydev, CTC_SDS_REG_SPACE, MII_BMCR, ctl);
-		if (ret < 0)
-			return ret;
-	}
-	return 0;
+	return ret;
 }
 
-static int mars_config_advert(struct phy_device *phydev)
+static int mars_ext_read(struct phy_device *phydev, u32 regnum)
 {
-#if (LINUX_VERSION_CODE >= KERNEL_VERSION(5, 0, 0))
-	__ETHTOOL_DECLARE_LINK_MODE_MASK(advertise);
-	u32 advertise_legacy;
-#else
-	u32 advertise;
-#endif
-	int oldadv, adv, bmsr;
-	int err, changed = 0;
+	int ret;
 
-	/* Only allow advertising what this PHY supports */
-#if (LINUX_VERSION_CODE >= KERNEL_VERSION(5, 0, 0))
-	linkmode_and(phydev->advertising, phydev->advertising,
-		     phydev->supported);
-	linkmode_copy(advertise, phydev->advertising);
-#else
-	phydev->advertising &= phydev->supported;
-	advertise = phydev->advertising;
-#endif
+	phy_lock_mdio_bus(phydev);
+	ret = __mars_ext_read(phydev, regnum);
+	phy_unlock_mdio_bus(phydev);
 
-	/* Setup standard advertisement */
-	adv = mars_page_read(phydev, CTC_PHY_REG_SPACE, MII_ADVERTISE);
-	if (adv < 0)
-		return adv;
+	return ret;
+}
 
-	oldadv = adv;
-	adv &= ~(ADVERTISE_ALL | ADVERTISE_100BASE4 | ADVERTISE_PAUSE_CAP |
-		 ADVERTISE_PAUSE_ASYM);
-#if (LINUX_VERSION_CODE >= KERNEL_VERSION(5, 0, 0))
-	ethtool_convert_link_mode_to_legacy_u32(&advertise_legacy, advertise);
-	adv |= ethtool_adv_to_mii_adv_t(advertise_legacy);
-#else
-	adv |= ethtool_adv_to_mii_adv_t(advertise);
-#endif
+static int mars_ext_write(struct phy_device *phydev, u32 regnum, u16 val)
+{
+	int ret;
 
-	if (adv != oldadv) {
-		err =
-		    mars_page_write(phydev, CTC_PHY_REG_SPACE, MII_ADVERTISE,
-				    adv);
+	phy_lock_mdio_bus(phydev);
+	ret = __mars_ext_write(phydev, regnum, val);
+	phy_unlock_mdio_bus(phydev);
 
-		if (err < 0)
-			return err;
-		changed = 1;
-	}
+	return ret;
+}
 
-	bmsr = mars_page_read(phydev, CTC_PHY_REG_SPACE, MII_BMSR);
-	if (bmsr < 0)
-		return bmsr;
+/* Forget the selected space, and the MMD address latched behind it */
+static void mars_reg_space_invalidate(struct phy_device *phydev)
+{
+	struct mars_priv *priv = phydev->priv;
 
-	/* Per 802.3-2008, Section 22.2.4.2.16 Extended status all
-	 * 1000Mbits/sec capable PHYs shall have the BMSR_ESTATEN bit set to a
-	 * logical 1.
-	 */
-	if (!(bmsr & BMSR_ESTATEN))
-		return changed;
+	priv->reg_space = CTC_REG_SPACE_UNKNOWN;
+	priv->mmd_devad = MARS_SHADOW_UNKNOWN;
+}
 
-	/* Configure gigabit if it's supported */
-	adv = mars_page_read(phydev, CTC_PHY_REG_SPACE, MII_CTRL1000);
-	if (adv < 0)
-		return adv;
+/* Forget the register values programmed before a reset */
+static void mars_shadow_invalidate(struct phy_device *phydev)
+{
+	struct mars_priv *priv = phydev->priv;
+
+	priv->bmcr[CTC_PHY_REG_SPACE] = MARS_SHADOW_UNKNOWN;
+	priv->bmcr[CTC_SDS_REG_SPACE] = MARS_SHADOW_UNKNOWN;
+	priv->advertise = MARS_SHADOW_UNKNOWN;
+	priv->ctrl1000 = MARS_SHADOW_UNKNOWN;
+	priv->mmd_devad = MARS_SHADOW_UNKNOWN;
+	priv->imask = MARS_SHADOW_UNKNOWN;
+	priv->ssreg_last = MARS_SHADOW_UNKNOWN;
+	priv->wol_cfg = MARS_SHADOW_UNKNOWN;
+	priv->wol_mac[0] = MARS_SHADOW_UNKNOWN;
+	priv->wol_mac[1] = MARS_SHADOW_UNKNOWN;
+	priv->wol_mac[2] = MARS_SHADOW_UNKNOWN;
+}
 
-	oldadv = adv;
-	adv &= ~(ADVERTISE_1000FULL | ADVERTISE_1000HALF);
+/* .read_page callback, the MDIO bus lock is held by the caller */
+static int mars_read_page(struct phy_device *phydev)
+{
+	struct mars_priv *priv = phydev->priv;
+	int val, space;
 
-#if (LINUX_VERSION_CODE >= KERNEL_VERSION(5, 0, 0))
-	if (linkmode_test_bit(ETHTOOL_LINK_MODE_1000baseT_Half_BIT, phydev->supported) ||
-	    linkmode_test_bit(ETHTOOL_LINK_MODE_1000baseT_Full_BIT, phydev->supported)) {
-		ethtool_convert_link_mode_to_legacy_u32(&advertise_legacy,
-							advertise);
-		adv |= ethtool_adv_to_mii_ctrl1000_t(advertise_legacy);
-	}
-#else
-	if (phydev->supported & (SUPPORTED_1000baseT_Half |
-				 SUPPORTED_1000baseT_Full)) {
-		adv |= ethtool_adv_to_mii_ctrl1000_t(advertise);
+	if (priv->reg_space != CTC_REG_SPACE_UNKNOWN) {
+		priv->stats.reg_space_saved++;
+		return priv->reg_space;
 	}
-#endif
 
-	if (adv != oldadv)
-		changed = 1;
+	val = __mars_ext_read_as(phydev, CTC_MARS_PAGE_REG, MARS_FRAME_PAGE);
+	if (val < 0)
+		return val;
 
-	err = mars_page_write(phydev, CTC_PHY_REG_SPACE, MII_CTRL1000, adv);
-	if (err < 0)
-		return err;
+	space = (val & 0x2) ? CTC_SDS_REG_SPACE : CTC_PHY_REG_SPACE;
+	priv->reg_space = space;
 
-	return changed;
+	return space;
 }
 
-int mars1s_config_aneg(struct phy_device *phydev)
+/* .write_page callback, the MDIO bus lock is held by the caller */
+static int mars_write_page(struct phy_device *phydev, int page)
 {
-	int err, changed = 0;
-	int ret = 0;
-	int port_type = 0;
+	struct mars_priv *priv = phydev->priv;
+	int ret;
 
-	port_type = *(int*)phydev->priv;
+	/* Already selected, no need to touch the selector */
+	if (priv->reg_space == page) {
+		priv->stats.reg_space_saved++;
+		return 0;
+	}
 
-	if (port_type == MARS_PORT_TYPE_UTP ||
-	    port_type == MARS_PORT_TYPE_COMBO) {
-		if (phydev->autoneg != AUTONEG_ENABLE)
-			ret = mars_setup_forced(phydev);
+	if (page == CTC_PHY_REG_SPACE)
+		ret = __mars_ext_write_as(phydev, CTC_MARS_PAGE_REG, 0x0,
+					  MARS_FRAME_PAGE);
+	else
+		ret = __mars_ext_write_as(phydev, CTC_MARS_PAGE_REG, 0x2,
+					  MARS_FRAME_PAGE);
+	priv->stats.page_switches++;
+
+	if (ret < 0)
+		mars_reg_space_invalidate(phydev);
+	else
+		priv->reg_space = page;
+
+	return ret;
+}
+
+#if (LINUX_VERSION_CODE < KERNEL_VERSION(4, 18, 0))
+static int phy_select_page(struct phy_device *phydev, int page)
+{
+	int ret, oldpage;
+
+	oldpage = mars_read_page(phydev);
+	if (oldpage < 0)
+		return oldpage;
+
+	ret = mars_write_page(phydev, page);
+	if (ret < 0)
+		return ret;
+
+	return oldpage;
+}
+
+static int phy_restore_page(struct phy_device *phydev, int oldpage, int ret)
+{
+	int r;
+
+	if (oldpage < 0)
+		return oldpage;
+
+	r = mars_write_page(phydev, oldpage);
+	if (ret >= 0 && r < 0)
+		ret = r;
+
+	return ret;
+}
+#endif
+
+static int mars_page_read(struct phy_device *phydev, int page, u32 regnum)
+{
+	int ret = 0, oldpage;
+
+	oldpage = phy_select_page(phydev, page);
+	if (oldpage >= 0)
+		ret = __mars_read(phydev, regnum);
+
+	return phy_restore_page(phydev, oldpage, ret);
+}
+
+static int mars_page_write(struct phy_device *phydev, int page, u32 regnum,
+			   u16 value)
+{
+	int ret = 0, oldpage;
+
+	oldpage = phy_select_page(phydev, page);
+	if (oldpage >= 0)
+		ret = __mars_write(phydev, regnum, value);
+
+	return phy_restore_page(phydev, oldpage, ret);
+}
+
+/* Locked section on a register space of a port_type port. Single medium
+ * ports only use their own space, selected once and kept: the selector may
+ * have been left on the other space by a bootloader, once the shadow is
+ * valid this costs no frame. Only combo ports save and restore the
+ * selected space.
+ */
+static __always_inline int mars_port_select(struct phy_device *phydev,
+					    const int port_type, int space)
+{
+	int ret;
+
+	if (port_type == MARS_PORT_TYPE_COMBO)
+		return phy_select_page(phydev, space);
+
+	phy_lock_mdio_bus(phydev);
+	ret = mars_write_page(phydev, port_type == MARS_PORT_TYPE_FIBER ?
+			      CTC_SDS_REG_SPACE : CTC_PHY_REG_SPACE);
+	if (ret < 0) {
+		phy_unlock_mdio_bus(phydev);
+		return ret;
+	}
+
+	return space;
+}
+
+static __always_inline int mars_port_restore(struct phy_device *phydev,
+					     const int port_type, int oldpage,
+					     int ret)
+{
+	if (port_type == MARS_PORT_TYPE_COMBO)
+		return phy_restore_page(phydev, oldpage, ret);
+
+	if (oldpage < 0)
+		return oldpage;
+	phy_unlock_mdio_bus(phydev);
+
+	return ret;
+}
+
+static __always_inline int mars_port_read(struct phy_device *phydev,
+					  const int port_type, int space,
+					  u32 regnum)
+{
+	int ret = 0, oldpage;
+
+	oldpage = mars_port_select(phydev, port_type, space);
+	if (oldpage >= 0)
+		ret = __mars_read(phydev, regnum);
+
+	return mars_port_restore(phydev, port_type, oldpage, ret);
+}
+
+/* Start of a locked section using the MMD address latch. With
+ * .read_mmd/.write_mmd all MMD accesses of phylib go through the driver
+ * and the latch is kept from one section to the next, like the other
+ * shadows only a raw SIOCSMIIREG write to MII_MMD_CTRL or MII_MMD_DATA
+ * goes unseen. Without them phylib moves it on its own.
+ */
+static void mars_mmd_begin(struct phy_device *phydev)
+{
+#ifndef MARS_MMD_OPS
+	struct mars_priv *priv = phydev->priv;
+
+	priv->mmd_devad = MARS_SHADOW_UNKNOWN;
+#endif
+}
+
+/* Point MII_MMD_DATA at devad/regnum in no increment mode, skipped when
+ * already latched. Bus lock held, UTP space selected.
+ */
+static int __mars_mmd_latch(struct phy_device *phydev, int devad, u16 regnum)
+{
+	struct mars_priv *priv = phydev->priv;
+	int ret;
+
+	if (priv->mmd_devad == devad && priv->mmd_reg == regnum)
+		return 0;
+	priv->mmd_devad = MARS_SHADOW_UNKNOWN;
+
+	ret = __mars_write(phydev, MII_MMD_CTRL, devad);
+	if (ret < 0)
+		return ret;
+	ret = __mars_write(phydev, MII_MMD_DATA, regnum);
+	if (ret < 0)
+		return ret;
+	ret = __mars_write(phydev, MII_MMD_CTRL, MII_MMD_CTRL_NOINCR | devad);
+	if (ret < 0)
+		return ret;
+
+	priv->mmd_devad = devad;
+	priv->mmd_reg = regnum;
+
+	return 0;
+}
+
+static int __mars_mmd_read(struct phy_device *phydev, int devad, u16 regnum)
+{
+	int ret;
+
+	ret = __mars_mmd_latch(phydev, devad, regnum);
+	if (ret < 0)
+		return ret;
+
+	return __mars_read(phydev, MII_MMD_DATA);
+}
+
+static int __mars_mmd_write(struct phy_device *phydev, int devad, u16 regnum,
+			    u16 val)
+{
+	int ret;
+
+	ret = __mars_mmd_latch(phydev, devad, regnum);
+	if (ret < 0)
+		return ret;
+
+	return __mars_write(phydev, MII_MMD_DATA, val);
+}
+
+/* Read count consecutive MMD registers with address post-increment, bus
+ * lock held, UTP space selected.
+ */
+static int __mars_mmd_read_bulk(struct phy_device *phydev, int devad,
+				u16 regnum, u16 *vals, int count)
+{
+	struct mars_priv *priv = phydev->priv;
+	int i, ret;
+
+	/* The address moves on with every read */
+	priv->mmd_devad = MARS_SHADOW_UNKNOWN;
+
+	ret = __mars_write(phydev, MII_MMD_CTRL, devad);
+	if (ret < 0)
+		return ret;
+	ret = __mars_write(phydev, MII_MMD_DATA, regnum);
+	if (ret < 0)
+		return ret;
+	ret = __mars_write(phydev, MII_MMD_CTRL,
+			   MII_MMD_CTRL_INCR_RDWT | devad);
+	if (ret < 0)
+		return ret;
+
+	for (i = 0; i < count; i++) {
+		ret = __mars_read(phydev, MII_MMD_DATA);
 		if (ret < 0)
 			return ret;
+		vals[i] = ret;
+	}
+
+	return 0;
+}
+
+#ifdef MARS_MMD_OPS
+/* .read_mmd callback, the MDIO bus lock is held by the caller. The MMDs
+ * sit behind the UTP register space.
+ */
+static int mars_read_mmd(struct phy_device *phydev, int devad, u16 regnum)
+{
+	int ret, r, oldpage;
+
+	oldpage = mars_read_page(phydev);
+	if (oldpage < 0)
+		return oldpage;
+
+	ret = mars_write_page(phydev, CTC_PHY_REG_SPACE);
+	if (ret >= 0)
+		ret = __mars_mmd_read(phydev, devad, regnum);
+
+	r = mars_write_page(phydev, oldpage);
+	if (ret >= 0 && r < 0)
+		ret = r;
+
+	return ret;
+}
+
+/* .write_mmd callback, the MDIO bus lock is held by the caller */
+static int mars_write_mmd(struct phy_device *phydev, int devad, u16 regnum,
+			  u16 val)
+{
+	struct mars_priv *priv = phydev->priv;
+	int ret, r, oldpage;
+
+	oldpage = mars_read_page(phydev);
+	if (oldpage < 0)
+		return oldpage;
+
+	ret = mars_write_page(phydev, CTC_PHY_REG_SPACE);
+	if (ret >= 0)
+		ret = __mars_mmd_write(phydev, devad, regnum, val);
+
+	/* phylib programs the EEE advertisement only when it is set */
+	if (ret >= 0 && devad == MDIO_MMD_AN && regnum == MDIO_AN_EEE_ADV)
+		priv->eee_adv = val;
+
+	r = mars_write_page(phydev, oldpage);
+	if (ret >= 0 && r < 0)
+		ret = r;
+
+	return ret;
+}
+#endif
+
+/* Access one sequence step in the selected space, bus lock held */
+static int __mars_reg_seq_read(struct phy_device *phydev,
+			       const struct mars_reg_seq_t *step)
+{
+	switch (step->type) {
+	case MARS_REG_TYPE_EXT:
+		return __mars_ext_read(phydev, step->reg);
+	case MARS_REG_TYPE_MMD:
+		return __mars_mmd_read(phydev, step->devad, step->reg);
+	default:
+		return __mars_read(phydev, step->reg);
+	}
+}
+
+static int __mars_reg_seq_write(struct phy_device *phydev,
+				const struct mars_reg_seq_t *step, u16 val)
+{
+	switch (step->type) {
+	case MARS_REG_TYPE_EXT:
+		/* The address is still latched from the read */
+		return __mars_ext_write_latched(phydev, step->reg, val);
+	case MARS_REG_TYPE_MMD:
+		/* The MMD address is still latched from the read */
+		return __mars_mmd_write(phydev, step->devad, step->reg, val);
+	default:
+		return __mars_write(phydev, step->reg, val);
+	}
+}
+
+/* Order the steps of a sequence so that each register space is visited
+ * only once, starting with the space of the first step.
+ */
+static void mars_reg_seq_order(const struct mars_reg_seq_t *seq, int count,
+			       u8 *order)
+{
+	int i, n = 0;
+
+	for (i = 0; i < count; i++)
+		if (seq[i].space == seq[0].space)
+			order[n++] = i;
+	for (i = 0; i < count; i++)
+		if (seq[i].space != seq[0].space)
+			order[n++] = i;
+}
+
+/* Apply a register sequence under a single bus lock. The steps are applied
+ * one register space at a time, so each space is selected at most once,
+ * and registers already holding the wanted value are not written. On error
+ * the steps written so far are reverted in reverse order.
+ */
+static int mars_apply_reg_seq(struct phy_device *phydev,
+			      const struct mars_reg_seq_t *seq, int count)
+{
+	u16 undo_val[MARS_REG_SEQ_MAX];
+	u8 undo_idx[MARS_REG_SEQ_MAX];
+	u8 order[MARS_REG_SEQ_MAX];
+	const struct mars_reg_seq_t *step;
+	int i, val, newval, oldpage;
+	int done = 0;
+	int ret = 0;
+	ktime_t start;
+
+	if (count > MARS_REG_SEQ_MAX)
+		return -EINVAL;
+	if (!count)
+		return 0;
+
+	mars_reg_seq_order(seq, count, order);
+
+	oldpage = phy_select_page(phydev, seq[0].space);
+	if (oldpage < 0)
+		goto out;
+	mars_mmd_begin(phydev);
+
+	for (i = 0; i < count; i++) {
+		step = &seq[order[i]];
+
+		/* Only touches the selector when the space changes */
+		ret = mars_write_page(phydev, step->space);
+		if (ret < 0)
+			goto unwind;
+
+		start = ktime_get();
+		val = __mars_reg_seq_read(phydev, step);
+		if (val < 0) {
+			ret = val;
+			goto unwind;
+		}
+
+		newval = (val & ~step->mask) | (step->val & step->mask);
+		if (newval != val) {
+			ret = __mars_reg_seq_write(phydev, step, newval);
+			if (ret < 0)
+				goto unwind;
+			undo_idx[done] = order[i];
+			undo_val[done] = val;
+			done++;
+		}
+		dev_dbg(mars_dev(phydev), "reg seq step %d: %lld ns\n",
+			order[i], ktime_to_ns(ktime_sub(ktime_get(), start)));
+	}
+	ret = 0;
+	goto out;
+
+unwind:
+	dev_err(mars_dev(phydev), "reg seq step %d failed: %d\n", order[i],
+		ret);
+	while (done--) {
+		step = &seq[undo_idx[done]];
+		if (mars_write_page(phydev, step->space) < 0 ||
+		    __mars_reg_seq_read(phydev, step) < 0)
+			break;
+		__mars_reg_seq_write(phydev, step, undo_val[done]);
+	}
+out:
+	return phy_restore_page(phydev, oldpage, ret);
+}
+
+/* Read the registers of a sequence under a single bus lock, one register
+ * space at a time. vals[i] receives the value of seq[i].
+ */
+static int mars_read_reg_seq(struct phy_device *phydev,
+			     const struct mars_reg_seq_t *seq, int count,
+			     u16 *vals)
+{
+	u16 bulk[MARS_REG_SEQ_MAX];
+	u8 order[MARS_REG_SEQ_MAX];
+	const struct mars_reg_seq_t *step, *next;
+	int i, k, n, val, oldpage;
+	int ret = 0;
+
+	if (count > MARS_REG_SEQ_MAX)
+		return -EINVAL;
+	if (!count)
+		return 0;
+
+	mars_reg_seq_order(seq, count, order);
+
+	oldpage = phy_select_page(phydev, seq[0].space);
+	if (oldpage < 0)
+		goto out;
+	mars_mmd_begin(phydev);
+
+	for (i = 0; i < count; i++) {
+		step = &seq[order[i]];
+		ret = mars_write_page(phydev, step->space);
+		if (ret < 0)
+			goto out;
+
+		/* Consecutive registers of one MMD are read in a single
+		 * post-increment run.
+		 */
+		for (n = 1; step->type == MARS_REG_TYPE_MMD && i + n < count;
+		     n++) {
+			next = &seq[order[i + n]];
+			if (next->type != MARS_REG_TYPE_MMD ||
+			    next->space != step->space ||
+			    next->devad != step->devad ||
+			    next->reg != step->reg + n)
+				break;
+		}
+		if (n > 1) {
+			ret = __mars_mmd_read_bulk(phydev, step->devad,
+						   step->reg, bulk, n);
+			if (ret < 0)
+				goto out;
+			for (k = 0; k < n; k++)
+				vals[order[i + k]] = bulk[k];
+			i += n - 1;
+			continue;
+		}
+
+		val = __mars_reg_seq_read(phydev, step);
+		if (val < 0) {
+			ret = val;
+			goto out;
+		}
+		vals[order[i]] = val;
+	}
+
+out:
+	return phy_restore_page(phydev, oldpage, ret);
+}
+
+/* BMCR of the selected space, from the shadow when known, bus lock held */
+static int __mars_bmcr_read(struct phy_device *phydev, int space)
+{
+	struct mars_priv *priv = phydev->priv;
+	int ret;
+
+	if (priv->bmcr[space] != MARS_SHADOW_UNKNOWN)
+		return priv->bmcr[space];
+
+	ret = __mars_read(phydev, MII_BMCR);
+	if (ret >= 0)
+		priv->bmcr[space] = ret;
+
+	return ret;
+}
+
+/* Program BMCR of the selected space unless it already holds val */
+static int __mars_bmcr_write(struct phy_device *phydev, int space, u16 val)
+{
+	struct mars_priv *priv = phydev->priv;
+	int ret;
+
+	if (priv->bmcr[space] == val)
+		return 0;
+
+	ret = __mars_write(phydev, MII_BMCR, val);
+	priv->bmcr[space] = (ret < 0) ? MARS_SHADOW_UNKNOWN : val;
+
+	return ret;
+}
+
+/* BMCR of a space in its own locked section, skipped when shadowed */
+static __always_inline int mars_port_read_bmcr(struct phy_device *phydev,
+					       const int port_type, int space)
+{
+	struct mars_priv *priv = phydev->priv;
+	int ret;
+
+	if (priv->bmcr[space] != MARS_SHADOW_UNKNOWN)
+		return priv->bmcr[space];
+
+	ret = mars_port_read(phydev, port_type, space, MII_BMCR);
+	if (ret >= 0)
+		priv->bmcr[space] = ret;
+
+	return ret;
+}
+
+static __always_inline int __mars_setup_forced(struct phy_device *phydev,
+					       const int port_type)
+{
+	int ctl = 0;
+	int ret = 0;
+	int oldpage;
+
+	/* Handle both spaces in a single locked section */
+	oldpage = mars_port_select(phydev, port_type,
+				   port_type == MARS_PORT_TYPE_FIBER ?
+				   CTC_SDS_REG_SPACE : CTC_PHY_REG_SPACE);
+	if (oldpage < 0)
+		goto out;
+
+	if (port_type == MARS_PORT_TYPE_UTP ||
+	    port_type == MARS_PORT_TYPE_COMBO) {
+		ctl = __mars_bmcr_read(phydev, CTC_PHY_REG_SPACE);
+		if (ctl < 0) {
+			ret = ctl;
+			goto out;
+		}
+		ctl &= BMCR_LOOPBACK | BMCR_ISOLATE | BMCR_PDOWN;
+		phydev->pause = 0;
+		phydev->asym_pause = 0;
+
+		if (phydev->speed == SPEED_1000)
+			ctl |= BMCR_SPEED1000;
+		else if (phydev->speed == SPEED_100)
+			ctl |= BMCR_SPEED100;
+
+		if (phydev->duplex == DUPLEX_FULL)
+			ctl |= BMCR_FULLDPLX;
+
+		ret = __mars_bmcr_write(phydev, CTC_PHY_REG_SPACE, ctl);
+		if (ret < 0)
+			goto out;
+	}
+
+	if (port_type == MARS_PORT_TYPE_FIBER ||
+	    port_type == MARS_PORT_TYPE_COMBO) {
+		if (port_type == MARS_PORT_TYPE_COMBO) {
+			ret = mars_write_page(phydev, CTC_SDS_REG_SPACE);
+			if (ret < 0)
+				goto out;
+		}
+
+		ctl = __mars_bmcr_read(phydev, CTC_SDS_REG_SPACE);
+		if (ctl < 0) {
+			ret = ctl;
+			goto out;
+		}
+		ctl &= ~BMCR_ANENABLE;
+		ret = __mars_bmcr_write(phydev, CTC_SDS_REG_SPACE, ctl);
+		if (ret < 0)
+			goto out;
+	}
+
+out:
+	return mars_port_restore(phydev, port_type, oldpage, ret);
+}
+
+/* Restart autonegotiation in the register spaces set in the spaces mask,
+ * BIT(CTC_PHY_REG_SPACE) and/or BIT(CTC_SDS_REG_SPACE).
+ */
+static __always_inline int __mars_restart_aneg(struct phy_device *phydev,
+					       const int port_type,
+					       unsigned int spaces)
+{
+	struct mars_priv *priv = phydev->priv;
+	int ctl = 0;
+	int ret = 0;
+	int oldpage;
+
+	if (port_type == MARS_PORT_TYPE_UTP)
+		spaces &= BIT(CTC_PHY_REG_SPACE);
+	else if (port_type == MARS_PORT_TYPE_FIBER)
+		spaces &= BIT(CTC_SDS_REG_SPACE);
+	if (!spaces)
+		return 0;
+	trace_mars_aneg_restart(phydev, spaces);
+
+	/* Handle both spaces in a single locked section */
+	oldpage = mars_port_select(phydev, port_type,
+				   (spaces & BIT(CTC_PHY_REG_SPACE)) ?
+				   CTC_PHY_REG_SPACE : CTC_SDS_REG_SPACE);
+	if (oldpage < 0)
+		goto out;
+
+	if (port_type != MARS_PORT_TYPE_FIBER &&
+	    (spaces & BIT(CTC_PHY_REG_SPACE))) {
+		ctl = __mars_bmcr_read(phydev, CTC_PHY_REG_SPACE);
+		if (ctl < 0) {
+			ret = ctl;
+			goto out;
+		}
+
+		ctl |= BMCR_ANENABLE | BMCR_ANRESTART;
+
+		/* Don't isolate the PHY if we're negotiating */
+		ctl &= ~BMCR_ISOLATE;
+
+		ret = __mars_write(phydev, MII_BMCR, ctl);
+		if (ret < 0) {
+			priv->bmcr[CTC_PHY_REG_SPACE] = MARS_SHADOW_UNKNOWN;
+			goto out;
+		}
+		/* BMCR_ANRESTART is self clearing */
+		priv->bmcr[CTC_PHY_REG_SPACE] = ctl & ~BMCR_ANRESTART;
+	}
+
+	if (port_type != MARS_PORT_TYPE_UTP &&
+	    (spaces & BIT(CTC_SDS_REG_SPACE))) {
+		if (port_type == MARS_PORT_TYPE_COMBO) {
+			ret = mars_write_page(phydev, CTC_SDS_REG_SPACE);
+			if (ret < 0)
+				goto out;
+		}
+
+		ctl = __mars_bmcr_read(phydev, CTC_SDS_REG_SPACE);
+		if (ctl < 0) {
+			ret = ctl;
+			goto out;
+		}
+		ret = __mars_bmcr_write(phydev, CTC_SDS_REG_SPACE,
+					ctl | BMCR_ANENABLE);
+		if (ret < 0)
+			goto out;
+	}
+
+out:
+	return mars_port_restore(phydev, port_type, oldpage, ret);
+}
+
+static __always_inline int __mars_config_advert(struct phy_device *phydev,
+						const int port_type)
+{
+#if (LINUX_VERSION_CODE >= KERNEL_VERSION(5, 0, 0))
+	__ETHTOOL_DECLARE_LINK_MODE_MASK(advertise);
+	u32 advertise_legacy;
+#else
+	u32 advertise;
+#endif
+	struct mars_priv *priv = phydev->priv;
+	int oldadv, adv, bmsr;
+	int changed = 0;
+	int ret = 0;
+	int oldpage;
+
+	/* Only allow advertising what this PHY supports */
+#if (LINUX_VERSION_CODE >= KERNEL_VERSION(5, 0, 0))
+	linkmode_and(phydev->advertising, phydev->advertising,
+		     phydev->supported);
+	linkmode_copy(advertise, phydev->advertising);
+#else
+	phydev->advertising &= phydev->supported;
+	advertise = phydev->advertising;
+#endif
+
+	oldpage = mars_port_select(phydev, port_type, CTC_PHY_REG_SPACE);
+	if (oldpage < 0)
+		goto out;
+
+	/* Setup standard advertisement, based on the last programmed value */
+	adv = priv->advertise;
+	if (adv == MARS_SHADOW_UNKNOWN)
+		adv = __mars_read(phydev, MII_ADVERTISE);
+	if (adv < 0) {
+		ret = adv;
+		goto out;
+	}
+
+	oldadv = adv;
+	adv &= ~(ADVERTISE_ALL | ADVERTISE_100BASE4 | ADVERTISE_PAUSE_CAP |
+		 ADVERTISE_PAUSE_ASYM);
+#if (LINUX_VERSION_CODE >= KERNEL_VERSION(5, 0, 0))
+	ethtool_convert_link_mode_to_legacy_u32(&advertise_legacy, advertise);
+	adv |= ethtool_adv_to_mii_adv_t(advertise_legacy);
+#else
+	adv |= ethtool_adv_to_mii_adv_t(advertise);
+#endif
+
+	if (adv != oldadv) {
+		ret = __mars_write(phydev, MII_ADVERTISE, adv);
+		if (ret < 0) {
+			priv->advertise = MARS_SHADOW_UNKNOWN;
+			goto out;
+		}
+		changed = 1;
+	}
+	priv->advertise = adv;
+
+	/* A CTRL1000 shadow means the gigabit registers were found before */
+	adv = priv->ctrl1000;
+	if (adv == MARS_SHADOW_UNKNOWN) {
+		bmsr = __mars_read(phydev, MII_BMSR);
+		if (bmsr < 0) {
+			ret = bmsr;
+			goto out;
+		}
+
+		/* Per 802.3-2008, Section 22.2.4.2.16 Extended status all
+		 * 1000Mbits/sec capable PHYs shall have the BMSR_ESTATEN bit
+		 * set to a logical 1.
+		 */
+		if (!(bmsr & BMSR_ESTATEN)) {
+			ret = changed;
+			goto out;
+		}
+
+		/* Configure gigabit if it's supported */
+		adv = __mars_read(phydev, MII_CTRL1000);
+		if (adv < 0) {
+			ret = adv;
+			goto out;
+		}
+	}
+
+	oldadv = adv;
+	adv &= ~(ADVERTISE_1000FULL | ADVERTISE_1000HALF);
+
+#if (LINUX_VERSION_CODE >= KERNEL_VERSION(5, 0, 0))
+	if (linkmode_test_bit(ETHTOOL_LINK_MODE_1000baseT_Half_BIT, phydev->supported) ||
+	    linkmode_test_bit(ETHTOOL_LINK_MODE_1000baseT_Full_BIT, phydev->supported)) {
+		ethtool_convert_link_mode_to_legacy_u32(&advertise_legacy,
+							advertise);
+		adv |= ethtool_adv_to_mii_ctrl1000_t(advertise_legacy);
+	}
+#else
+	if (phydev->supported & (SUPPORTED_1000baseT_Half |
+				 SUPPORTED_1000baseT_Full)) {
+		adv |= ethtool_adv_to_mii_ctrl1000_t(advertise);
+	}
+#endif
+
+	if (adv != oldadv) {
+		ret = __mars_write(phydev, MII_CTRL1000, adv);
+		if (ret < 0) {
+			priv->ctrl1000 = MARS_SHADOW_UNKNOWN;
+			goto out;
+		}
+		changed = 1;
+	}
+	priv->ctrl1000 = adv;
+
+	ret = changed;
+out:
+	return mars_port_restore(phydev, port_type, oldpage, ret);
+}
+
+static __always_inline int __mars1s_config_aneg(struct phy_device *phydev,
+						const int port_type)
+{
+	unsigned int restart = 0;
+	int ctl, changed;
+
+	/* Forced mode, both spaces in one section */
+	if (phydev->autoneg != AUTONEG_ENABLE)
+		return __mars_setup_forced(phydev, port_type);
+
+	if (port_type == MARS_PORT_TYPE_UTP ||
+	    port_type == MARS_PORT_TYPE_COMBO) {
+		changed = __mars_config_advert(phydev, port_type);
+		if (changed < 0)	/* error */
+			return changed;
+
+		if (changed == 0) {
+			/* Advertisement hasn't changed,
+			 * but maybe aneg was never on to
+			 * begin with?  Or maybe phy was isolated?
+			 */
+			ctl = mars_port_read_bmcr(phydev, port_type,
+						  CTC_PHY_REG_SPACE);
+			if (ctl < 0)
+				return ctl;
+
+			if (!(ctl & BMCR_ANENABLE) || (ctl & BMCR_ISOLATE))
+				changed = 1;	/* do restart aneg */
+		}
+
+		/* Only restart aneg if we are advertising something different
+		 * than we were before.
+		 */
+		if (changed > 0)
+			restart |= BIT(CTC_PHY_REG_SPACE);
+	}
+
+	if (port_type == MARS_PORT_TYPE_FIBER ||
+	    port_type == MARS_PORT_TYPE_COMBO) {
+		/* Nothing to do while SerDes autonegotiation is already on */
+		ctl = mars_port_read_bmcr(phydev, port_type, CTC_SDS_REG_SPACE);
+		if (ctl < 0)
+			return ctl;
+
+		if (!(ctl & BMCR_ANENABLE))
+			restart |= BIT(CTC_SDS_REG_SPACE);
+	}
+
+	return __mars_restart_aneg(phydev, port_type, restart);
+}
+
+static uint poll_fast_ms = 250;
+module_param(poll_fast_ms, uint, 0644);
+MODULE_PARM_DESC(poll_fast_ms,
+		 "Polling period after a link change or a negotiation restart, 0 for the phylib rate (default: 250)");
+
+static uint poll_stable_s = 60;
+module_param(poll_stable_s, uint, 0644);
+MODULE_PARM_DESC(poll_stable_s,
+		 "Seconds without change before polls only check the status register, 0 to always read the full status (default: 60)");
+
+/* Fast polling lasts this long after a change */
+#define MARS_POLL_FAST_HOLD_MS		5000
+/* Full status read period of a stable link */
+#define MARS_POLL_FULL_MS		10000
+/* phylib polling period, PHY_STATE_TIME */
+#define MARS_POLL_PHYLIB_MS		1000
+
+static const char * const mars_poll_mode_names[MARS_POLL_MODE_MAX] = {
+	[MARS_POLL_FAST] = "fast",
+	[MARS_POLL_NORMAL] = "normal",
+	[MARS_POLL_STABLE] = "stable",
+};
+
+static int mars_poll_mode(struct mars_priv *priv)
+{
+	unsigned int fast = READ_ONCE(poll_fast_ms);
+	unsigned int stable = READ_ONCE(poll_stable_s);
+	unsigned long since = jiffies - priv->poll_change;
+
+	if (fast && fast < MARS_POLL_PHYLIB_MS &&
+	    since < msecs_to_jiffies(MARS_POLL_FAST_HOLD_MS))
+		return MARS_POLL_FAST;
+	if (stable && since >= (unsigned long)stable * HZ)
+		return MARS_POLL_STABLE;
+
+	return MARS_POLL_NORMAL;
+}
+
+/* Extra state machine runs of a polled PHY in fast mode */
+static void mars_poll_work(struct work_struct *work)
+{
+	struct mars_priv *priv =
+	    container_of(to_delayed_work(work), struct mars_priv, poll_work);
+
+	phy_trigger_machine(priv->phydev);
+}
+
+static void mars_poll_update(struct phy_device *phydev, bool changed)
+{
+	struct mars_priv *priv = phydev->priv;
+
+	if (changed)
+		priv->poll_change = jiffies;
+
+	if (phydev->irq == PHY_POLL && mars_poll_mode(priv) == MARS_POLL_FAST)
+		schedule_delayed_work(&priv->poll_work,
+				      msecs_to_jiffies(READ_ONCE(poll_fast_ms)));
+}
+
+int mars1s_config_aneg(struct phy_device *phydev)
+{
+	struct mars_priv *priv = phydev->priv;
+	ktime_t start;
+	bool acct = mars_acct_begin(phydev, MARS_CB_CONFIG_ANEG, &start);
+	int ret;
+
+	ret = priv->ops->config_aneg(phydev);
+	if (ret >= 0)
+		mars_poll_update(phydev, true);
+	if (acct)
+		mars_acct_end(phydev, MARS_CB_CONFIG_ANEG, start);
+
+	return ret;
+}
+
+static int mars_ack_interrupt(struct phy_device *phydev)
+{
+	int err;
+
+	/* Clear the interrupts by reading the reg */
+	err = mars_page_read(phydev, CTC_PHY_REG_SPACE, CTC_PHY_IEVENT);
+	if (err < 0)
+		return err;
+
+	return 0;
+}
+
+static ushort irq_mask = CTC_PHY_IMASK_INIT;
+module_param(irq_mask, ushort, 0444);
+MODULE_PARM_DESC(irq_mask,
+		 "Link events unmasked in CTC_PHY_IMASK, ctc,irq-mask overrides it per PHY (default: 0x6c00)");
+
+static uint irq_storm = 500;
+module_param(irq_storm, uint, 0644);
+MODULE_PARM_DESC(irq_storm,
+		 "Interrupts per second above which link events are polled instead, 0 to never throttle (default: 500)");
+
+/* Throttled polling period and quiet polls needed to unmask again */
+#define MARS_IRQ_POLL_MS		100
+#define MARS_IRQ_CALM_POLLS		50
+
+/* The mask wanted by the current interrupt, WOL and throttle state */
+static u16 mars_imask(struct mars_priv *priv)
+{
+	u16 mask = 0;
+
+	if (priv->irq_enabled && !priv->irq_throttled)
+		mask |= priv->irq_events;
+	if (priv->wol_irq)
+		mask |= CTC_MARS_WOL_INTR;
+
+	return mask;
+}
+
+/* Only writer of CTC_PHY_IMASK. The mask is composed under the bus lock so
+ * concurrent config_intr, set_wol and throttle updates can't undo each
+ * other, and it is only written when it changes.
+ */
+static int __mars_write_imask(struct phy_device *phydev)
+{
+	struct mars_priv *priv = phydev->priv;
+	u16 mask = mars_imask(priv);
+	int ret;
+
+	if (priv->imask == mask)
+		return 0;
+
+	ret = __mars_write(phydev, CTC_PHY_IMASK, mask);
+	priv->imask = (ret < 0) ? MARS_SHADOW_UNKNOWN : mask;
+
+	return ret;
+}
+
+static int mars_write_imask(struct phy_device *phydev)
+{
+	int ret = 0, oldpage;
+
+	oldpage = phy_select_page(phydev, CTC_PHY_REG_SPACE);
+	if (oldpage >= 0)
+		ret = __mars_write_imask(phydev);
+
+	return phy_restore_page(phydev, oldpage, ret);
+}
+
+/* Link events of a throttled PHY, the event register latches them while
+ * they are masked
+ */
+static void mars_irq_poll_work(struct work_struct *work)
+{
+	struct mars_priv *priv =
+	    container_of(to_delayed_work(work), struct mars_priv, irq_work);
+	struct phy_device *phydev = priv->phydev;
+	bool link = false, calm = false;
+	int events;
+
+	events = mars_page_read(phydev, CTC_PHY_REG_SPACE, CTC_PHY_IEVENT);
+
+	spin_lock(&priv->irq_lock);
+	if (!priv->irq_throttled) {
+		spin_unlock(&priv->irq_lock);
+		return;
+	}
+	if (events >= 0 && (events & priv->irq_events)) {
+		priv->irq_calm_polls = 0;
+		link = true;
+	} else if (++priv->irq_calm_polls >= MARS_IRQ_CALM_POLLS) {
+		priv->irq_throttled = false;
+		priv->irq_window = jiffies;
+		priv->irq_window_count = 0;
+		calm = true;
+	}
+	spin_unlock(&priv->irq_lock);
+
+	if (link)
+		phy_trigger_machine(phydev);
+	if (calm) {
+		/* The mask follows the state at the time it is written */
+		if (mars_write_imask(phydev) >= 0) {
+			dev_info(mars_dev(phydev),
+				 "interrupt rate back to normal\n");
+			return;
+		}
+		spin_lock(&priv->irq_lock);
+		priv->irq_throttled = true;
+		priv->irq_calm_polls = 0;
+		spin_unlock(&priv->irq_lock);
+	}
+
+	schedule_delayed_work(&priv->irq_work,
+			      msecs_to_jiffies(MARS_IRQ_POLL_MS));
+}
+
+static int mars_config_intr(struct phy_device *phydev)
+{
+	struct mars_priv *priv = phydev->priv;
+	int err;
+
+	priv->irq_enabled = (phydev->interrupts == PHY_INTERRUPT_ENABLED);
+	if (!priv->irq_enabled) {
+		cancel_delayed_work_sync(&priv->irq_work);
+		spin_lock(&priv->irq_lock);
+		priv->irq_throttled = false;
+		spin_unlock(&priv->irq_lock);
+	}
+
+	/* Drop stale events so they don't fire as soon as the mask opens */
+	err = mars_ack_interrupt(phydev);
+	if (err < 0)
+		return err;
+
+	spin_lock(&priv->irq_lock);
+	priv->irq_window = jiffies;
+	priv->irq_window_count = 0;
+	spin_unlock(&priv->irq_lock);
+
+	return mars_write_imask(phydev);
+}
+
+#if (LINUX_VERSION_CODE >= KERNEL_VERSION(5, 11, 0))
+/* Count the interrupt in the current one second window. Past irq_storm
+ * interrupts the link events are masked and polled by irq_work until
+ * MARS_IRQ_CALM_POLLS polls in a row find none.
+ */
+static void mars_irq_rate_update(struct phy_device *phydev)
+{
+	struct mars_priv *priv = phydev->priv;
+	unsigned int storm = READ_ONCE(irq_storm);
+	bool throttle;
+
+	spin_lock(&priv->irq_lock);
+	if (time_after_eq(jiffies, priv->irq_window + HZ)) {
+		priv->stats.irq_rate = priv->irq_window_count;
+		priv->irq_window = jiffies;
+		priv->irq_window_count = 0;
+	}
+
+	throttle = ++priv->irq_window_count > storm && storm &&
+		   !priv->irq_throttled;
+	if (throttle) {
+		priv->irq_throttled = true;
+		priv->irq_calm_polls = 0;
+		priv->stats.irq_storms++;
+	}
+	spin_unlock(&priv->irq_lock);
+	if (!throttle)
+		return;
+
+	/* Nothing polls the events yet, keep them unmasked */
+	if (mars_write_imask(phydev) < 0) {
+		spin_lock(&priv->irq_lock);
+		priv->irq_throttled = false;
+		spin_unlock(&priv->irq_lock);
+		return;
+	}
+
+	dev_warn(mars_dev(phydev), "interrupt storm, polling the link events\n");
+	schedule_delayed_work(&priv->irq_work,
+			      msecs_to_jiffies(MARS_IRQ_POLL_MS));
+}
+
+static irqreturn_t mars_handle_interrupt(struct phy_device *phydev)
+{
+	struct mars_priv *priv = phydev->priv;
+	int irq_status;
+
+	/* Reading the event register also clears it */
+	irq_status = mars_page_read(phydev, CTC_PHY_REG_SPACE, CTC_PHY_IEVENT);
+	if (irq_status < 0) {
+		phy_error(phydev);
+		return IRQ_NONE;
+	}
+	trace_mars_irq(phydev, irq_status, priv->irq_throttled);
+
+	if (!(irq_status & (priv->irq_events | CTC_PHY_IEVENT_WOL)))
+		return IRQ_NONE;
+
+	priv->stats.interrupts++;
+	if (irq_status & CTC_PHY_IEVENT_LINK_UP)
+		priv->stats.irq_link_up++;
+	if (irq_status & CTC_PHY_IEVENT_LINK_DOWN)
+		priv->stats.irq_link_down++;
+	if (irq_status & (CTC_PHY_IEVENT_SPEED_CHG | CTC_PHY_IEVENT_DUPLEX_CHG))
+		priv->stats.irq_speed_chg++;
+	if (irq_status & CTC_PHY_IEVENT_WOL)
+		priv->stats.irq_wol++;
+
+	mars_irq_rate_update(phydev);
+
+	/* A WOL event alone doesn't change the link */
+	if (irq_status & priv->irq_events)
+		phy_trigger_machine(phydev);
+
+	return IRQ_HANDLED;
+}
+#endif
+
+static bool fast_status = true;
+module_param(fast_status, bool, 0644);
+MODULE_PARM_DESC(fast_status,
+		 "Take the link from the real time status register instead of the latched BMSR (default: on)");
+
+static int mars_medium_space(int medium)
+{
+	return (medium == MARS_PORT_TYPE_FIBER) ?
+		CTC_SDS_REG_SPACE : CTC_PHY_REG_SPACE;
+}
+
+/* Read CTC_MARS_SSREG of the selected register space with the link bit
+ * resolved, bus lock held.
+ */
+static int __mars_read_ssreg_link(struct phy_device *phydev, bool was_up)
+{
+	int bmsr = 0;
+	int ret;
+
+	if (!fast_status) {
+		/* The link bit is latched low. A drop of a link that was up
+		 * has to be reported, otherwise read again for the current
+		 * state.
+		 */
+		bmsr = __mars_read(phydev, MII_BMSR);
+		if (bmsr >= 0 && !was_up && !(bmsr & BMSR_LSTATUS))
+			bmsr = __mars_read(phydev, MII_BMSR);
+		if (bmsr < 0)
+			return bmsr;
+	}
+
+	ret = __mars_read(phydev, CTC_MARS_SSREG);
+	if (ret < 0)
+		return ret;
+
+	if (!fast_status) {
+		ret &= ~CTC_MARS_SSREG_LINK;
+		if (bmsr & BMSR_LSTATUS)
+			ret |= CTC_MARS_SSREG_LINK;
+	} else if ((ret & CTC_MARS_SSREG_LINK) &&
+		   !(ret & CTC_MARS_SSREG_RESOLVED) &&
+		   phydev->autoneg == AUTONEG_ENABLE) {
+		/* Link without resolved speed, only BMSR tells whether
+		 * autonegotiation is still running.
+		 */
+		bmsr = __mars_read(phydev, MII_BMSR);
+		if (bmsr < 0)
+			return bmsr;
+		if (!(bmsr & BMSR_ANEGCOMPLETE))
+			ret &= ~CTC_MARS_SSREG_LINK;
+	}
+
+	return ret;
+}
+
+/* Read the status of one register space in a single locked section and
+ * return CTC_MARS_SSREG with the link bit resolved. The space is left
+ * selected when its link is up.
+ */
+static __always_inline int mars_read_space_link(struct phy_device *phydev,
+						const int port_type, int space,
+						bool was_up)
+{
+	int ret = 0;
+	int oldpage;
+
+	oldpage = mars_port_select(phydev, port_type, space);
+	if (oldpage < 0)
+		goto out;
+
+	ret = __mars_read_ssreg_link(phydev, was_up);
+	if (ret >= 0 && (ret & CTC_MARS_SSREG_LINK))
+		oldpage = space;
+
+out:
+	return mars_port_restore(phydev, port_type, oldpage, ret);
+}
+
+static const char * const mars_medium_policy_names[] = {
+	[MARS_MEDIUM_AUTO] = "auto",
+	[MARS_MEDIUM_PREFER_FIBER] = "prefer-fiber",
+	[MARS_MEDIUM_PREFER_COPPER] = "prefer-copper",
+	[MARS_MEDIUM_FIBER_ONLY] = "fiber-only",
+	[MARS_MEDIUM_COPPER_ONLY] = "copper-only",
+};
+
+static int mars_medium_policy_parse(const char *buf)
+{
+	int i;
+
+	for (i = 0; i < MARS_MEDIUM_POLICY_MAX; i++)
+		if (sysfs_streq(buf, mars_medium_policy_names[i]))
+			return i;
+
+	return -EINVAL;
+}
+
+/* Medium probed first: the preferred one, or the last active in auto */
+static int mars_medium_first(struct mars_priv *priv)
+{
+	switch (priv->medium_policy) {
+	case MARS_MEDIUM_PREFER_FIBER:
+	case MARS_MEDIUM_FIBER_ONLY:
+		return MARS_PORT_TYPE_FIBER;
+	case MARS_MEDIUM_PREFER_COPPER:
+	case MARS_MEDIUM_COPPER_ONLY:
+		return MARS_PORT_TYPE_UTP;
+	default:
+		return priv->active_medium;
+	}
+}
+
+/* A *-only policy powers the excluded medium down so that it doesn't
+ * link with its partner, any other policy powers both up. The prefer-*
+ * policies only set the probe order, the chip has no documented combo
+ * priority to program. Combo ports only, both spaces in one locked
+ * section.
+ */
+static int mars_medium_power(struct phy_device *phydev)
+{
+	struct mars_priv *priv = phydev->priv;
+	int space, ctl, pdown;
+	int ret = 0;
+	int oldpage;
+
+	oldpage = phy_select_page(phydev, CTC_PHY_REG_SPACE);
+	if (oldpage < 0)
+		goto out;
+
+	for (space = 0; space < ARRAY_SIZE(priv->bmcr); space++) {
+		if (space == CTC_PHY_REG_SPACE)
+			pdown = priv->medium_policy == MARS_MEDIUM_FIBER_ONLY;
+		else
+			pdown = priv->medium_policy == MARS_MEDIUM_COPPER_ONLY;
+
+		/* Only switch to a space that needs a change */
+		ctl = priv->bmcr[space];
+		if (ctl != MARS_SHADOW_UNKNOWN && !(ctl & BMCR_PDOWN) == !pdown)
+			continue;
+
+		ret = mars_write_page(phydev, space);
+		if (ret < 0)
+			goto out;
+		ctl = __mars_bmcr_read(phydev, space);
+		if (ctl < 0) {
+			ret = ctl;
+			goto out;
+		}
+		ret = __mars_bmcr_write(phydev, space,
+					pdown ? ctl | BMCR_PDOWN :
+					ctl & ~BMCR_PDOWN);
+		if (ret < 0)
+			goto out;
+	}
+
+out:
+	return phy_restore_page(phydev, oldpage, ret);
+}
+
+/* A failover keeps the link up. phylib only reconfigures the MAC on a
+ * link change, so a switch to another speed or duplex is reported as a
+ * short drop, read again right away.
+ */
+static void mars_set_medium(struct phy_device *phydev, int medium,
+			    int status, bool was_up)
+{
+	struct mars_priv *priv = phydev->priv;
+	int mode = status & CTC_MARS_SSREG_MODE_MASK;
+
+	phydev->link = 1;
+	if (priv->active_medium != medium) {
+		priv->active_medium = medium;
+		priv->stats.medium_switches++;
+		if (was_up && mode != priv->link_mode) {
+			phydev->link = 0;
+			priv->medium_relink = true;
+			phy_trigger_machine(phydev);
+		}
+	}
+	priv->link_mode = mode;
+}
+
+/* Probe the preferred medium, or the one that had the link last, first.
+ * The other medium of a combo port is probed right after the link was
+ * lost, on every interrupt driven update, and otherwise only every
+ * MARS_IDLE_PROBE_POLLS polls. With a preferred medium the backup link
+ * is thus taken over by the update that sees the primary go down.
+ * status is CTC_MARS_SSREG of the first medium when it has already been
+ * read, MARS_SHADOW_UNKNOWN otherwise: reading the latched BMSR again
+ * would lose a drop the first read cleared.
+ * Returns CTC_MARS_SSREG of the medium in *port_status.
+ */
+static __always_inline int mars_update_link(struct phy_device *phydev,
+					    const int port_type, int status,
+					    int *port_status)
+{
+	struct mars_priv *priv = phydev->priv;
+	int active, idle, ret;
+	bool was_up = phydev->link || priv->medium_relink;
+
+	priv->medium_relink = false;
+	if (port_type == MARS_PORT_TYPE_COMBO)
+		active = mars_medium_first(priv);
+	else
+		active = port_type;
+	idle = (active == MARS_PORT_TYPE_UTP) ?
+		MARS_PORT_TYPE_FIBER : MARS_PORT_TYPE_UTP;
+	*port_status = active;
+
+	if (status == MARS_SHADOW_UNKNOWN)
+		status = mars_read_space_link(phydev, port_type,
+					      mars_medium_space(active),
+					      was_up);
+	if (status < 0)
+		return status;
+
+	if (status & CTC_MARS_SSREG_LINK) {
+		mars_set_medium(phydev, active, status, was_up);
+		priv->idle_polls = 0;
+		return status;
+	}
+
+	phydev->link = 0;
+	if (port_type != MARS_PORT_TYPE_COMBO ||
+	    priv->medium_policy == MARS_MEDIUM_FIBER_ONLY ||
+	    priv->medium_policy == MARS_MEDIUM_COPPER_ONLY)
+		return status;
+	if (!was_up && !phy_interrupt_is_valid(phydev) &&
+	    ++priv->idle_polls < MARS_IDLE_PROBE_POLLS)
+		return status;
+	priv->idle_polls = 0;
+
+	ret = mars_read_space_link(phydev, port_type,
+				   mars_medium_space(idle), false);
+	if (ret < 0)
+		return ret;
+
+	if (ret & CTC_MARS_SSREG_LINK) {
+		mars_set_medium(phydev, idle, ret, was_up);
+		*port_status = idle;
+		status = ret;
+	}
+
+	return status;
+}
+
+static void mars_decode_ssreg(struct phy_device *phydev, int val)
+{
+	phydev->speed = SPEED_10;
+	phydev->duplex = DUPLEX_HALF;
+	phydev->pause = 0;
+	phydev->asym_pause = 0;
+
+	if (val & CTC_MARS_SSREG_SPEED_1000) {
+		phydev->speed = SPEED_1000;
+		phydev->duplex = DUPLEX_FULL;
+	} else if (val & CTC_MARS_SSREG_SPEED_100) {
+		phydev->speed = SPEED_100;
+		if (val & CTC_MARS_SSREG_DUPLEX_FULL)
+			phydev->duplex = DUPLEX_FULL;
+	} else if (val & CTC_MARS_SSREG_DUPLEX_FULL) {
+		phydev->duplex = DUPLEX_FULL;
+	}
+}
+
+/* Gigabit is advertised on the copper side */
+static bool mars_adv_gigabit(struct phy_device *phydev)
+{
+	struct mars_priv *priv = phydev->priv;
+
+	return priv->ctrl1000 != MARS_SHADOW_UNKNOWN &&
+	       (priv->ctrl1000 & (ADVERTISE_1000FULL | ADVERTISE_1000HALF));
+}
+
+/* A copper link that came up below gigabit while both ends advertise it
+ * was downshifted. A forced link, an unknown advertisement or a
+ * partner's STAT1000 without gigabit reports nothing. Each one is
+ * counted in the downshifts statistic, the log is rate limited.
+ */
+static void mars_note_downshift(struct phy_device *phydev, int stat1000)
+{
+	struct mars_priv *priv = phydev->priv;
+
+	if (phydev->autoneg != AUTONEG_ENABLE || phydev->speed == SPEED_1000 ||
+	    !mars_adv_gigabit(phydev) ||
+	    !(stat1000 & (LPA_1000FULL | LPA_1000HALF)))
+		return;
+
+	priv->stats.downshifts++;
+	dev_info_ratelimited(mars_dev(phydev), "link downshifted to %d Mbps\n",
+			     phydev->speed);
+}
+
+/* Whether a stable polled link may be confirmed from CTC_MARS_SSREG alone.
+ * A combo port on its backup medium keeps probing for the primary.
+ */
+static bool mars_poll_cheap(struct phy_device *phydev, int port_type)
+{
+	struct mars_priv *priv = phydev->priv;
+
+	if (phydev->irq != PHY_POLL || !phydev->link ||
+	    priv->ssreg_last == MARS_SHADOW_UNKNOWN)
+		return false;
+	if (port_type == MARS_PORT_TYPE_COMBO &&
+	    priv->active_medium != mars_medium_first(priv))
+		return false;
+	if (time_after_eq(jiffies,
+			  priv->poll_full + msecs_to_jiffies(MARS_POLL_FULL_MS)))
+		return false;
+
+	return mars_poll_mode(priv) == MARS_POLL_STABLE;
+}
+
+static __always_inline int __mars_read_status(struct phy_device *phydev,
+					      const int port_type)
+{
+	struct mars_priv *priv = phydev->priv;
+	int val = MARS_SHADOW_UNKNOWN;
+	int lpa, page, stat1000;
+	int port_status = 0;
+	bool was_up = phydev->link;
+
+	/* Nothing to update while the status register is unchanged. The
+	 * cheap path only runs on the first medium, a change is taken over
+	 * by the full update.
+	 */
+	if (mars_poll_cheap(phydev, port_type)) {
+		val = mars_read_space_link(phydev, port_type,
+					   mars_medium_space(priv->active_medium),
+					   true);
+		if (val < 0)
+			return val;
+		if (val == priv->ssreg_last)
+			return 0;
+	}
+
+	/* Link, speed and duplex all come from CTC_MARS_SSREG */
+	val = mars_update_link(phydev, port_type, val, &port_status);
+	if (val < 0)
+		return val;
+	trace_mars_link(phydev, port_status, val, phydev->link);
+	if (was_up && !phydev->link && !priv->medium_relink)
+		priv->stats.link_flaps++;
+	phydev->port = (port_status == MARS_PORT_TYPE_FIBER) ?
+		PORT_FIBRE : PORT_TP;
+
+	if (port_status)
+		page = CTC_SDS_REG_SPACE;
+	else
+		page = CTC_PHY_REG_SPACE;
+
+	mars_decode_ssreg(phydev, val);
+
+	/* Downshift check, once when a copper link comes up slow */
+	if (port_type != MARS_PORT_TYPE_FIBER && !was_up && phydev->link &&
+	    port_status == MARS_PORT_TYPE_UTP &&
+	    phydev->speed != SPEED_1000 && mars_adv_gigabit(phydev)) {
+		stat1000 = mars_port_read(phydev, port_type, CTC_PHY_REG_SPACE,
+					  MII_STAT1000);
+		if (stat1000 < 0)
+			return stat1000;
+		mars_note_downshift(phydev, stat1000);
+	}
+
+	/* Pause is only resolved on a full duplex link. The space is still
+	 * selected from the link read, so no selector access is needed.
+	 */
+	if (phydev->link && phydev->duplex == DUPLEX_FULL) {
+		lpa = mars_port_read(phydev, port_type, page, MII_LPA);
+		if (lpa < 0)
+			return lpa;
+
+		phydev->pause = lpa & LPA_PAUSE_CAP ? 1 : 0;
+		phydev->asym_pause = lpa & LPA_PAUSE_ASYM ? 1 : 0;
+	}
+
+	priv->ssreg_last = phydev->link ? val : MARS_SHADOW_UNKNOWN;
+	priv->poll_full = jiffies;
+
+	return 0;
+}
+
+/* Defaults for a PHY without ctc,flap-damping: damping off */
+#define MARS_DAMP_HALF_LIFE_MS		15000
+#define MARS_DAMP_SUPPRESS		3000
+#define MARS_DAMP_REUSE			1000
+/* Bounds the figure, and so the hold time, to a few half-lives */
+#define MARS_DAMP_CEILING(d)		(4 * (d)->suppress)
+/* Largest penalty and suppress, the ceiling plus a penalty fits a u32 */
+#define MARS_DAMP_MAX			(U32_MAX / 8)
+
+static bool mars_damp_valid(u32 penalty, u32 half_life_ms, u32 suppress,
+			    u32 reuse)
+{
+	return half_life_ms && reuse < suppress && penalty <= MARS_DAMP_MAX &&
+	       suppress <= MARS_DAMP_MAX;
+}
+
+/* Decay the figure to now: 2^-t by whole half-lives, then linearly */
+static void mars_damp_decay(struct mars_damp_t *damp)
+{
+	unsigned long now = jiffies;
+	unsigned int ms = jiffies_to_msecs(now - damp->stamp);
+	unsigned int halves = ms / damp->half_life_ms;
+
+	damp->stamp = now;
+	if (halves >= 32) {
+		damp->figure = 0;
+		return;
+	}
+
+	damp->figure >>= halves;
+	ms %= damp->half_life_ms;
+	damp->figure -= div_u64(mul_u32_u32(damp->figure, ms),
+				2 * damp->half_life_ms);
+}
+
+static void mars_damp_work(struct work_struct *work)
+{
+	struct mars_priv *priv =
+	    container_of(to_delayed_work(work), struct mars_priv, damp_work);
+
+	phy_trigger_machine(priv->phydev);
+}
+
+/* Hand read_status the raw link, the callbacks compare against the
+ * hardware link and not the reported one. Returns the damped link to
+ * restore when the read fails.
+ */
+static int mars_damp_begin(struct phy_device *phydev)
+{
+	struct mars_priv *priv = phydev->priv;
+	int link = phydev->link;
+
+	if (priv->damp.penalty)
+		phydev->link = priv->damp.raw_link;
+
+	return link;
+}
+
+static void mars_damp_end(struct phy_device *phydev)
+{
+	struct mars_priv *priv = phydev->priv;
+	struct mars_damp_t *damp = &priv->damp;
+	bool was_up = damp->raw_link;
+
+	damp->raw_link = phydev->link;
+	if (!damp->penalty)
+		return;
+
+	mars_damp_decay(damp);
+	/* A failover relink is no flap */
+	if (was_up && !phydev->link && !priv->medium_relink) {
+		damp->figure = min(damp->figure + damp->penalty,
+				   MARS_DAMP_CEILING(damp));
+		if (!damp->suppressed && damp->figure >= damp->suppress) {
+			damp->suppressed = true;
+			priv->stats.flap_suppressions++;
+		}
+	}
+	if (damp->suppressed && damp->figure < damp->reuse)
+		damp->suppressed = false;
+
+	priv->stats.flap_penalty = damp->figure;
+	priv->stats.flap_suppressed = damp->suppressed;
+
+	if (!damp->suppressed || !phydev->link)
+		return;
+
+	if (!was_up)
+		priv->stats.flap_held_ups++;
+	phydev->link = 0;
+	if (phydev->irq != PHY_POLL)
+		schedule_delayed_work(&priv->damp_work, HZ);
+}
+
+/* Returns whether the reported link changed since the last snapshot */
+static bool mars_snapshot_update(struct phy_device *phydev)
+{
+	struct mars_priv *priv = phydev->priv;
+	struct mars_snapshot_t *snap = &priv->snap;
+	bool changed;
+
+	changed = snap->link != phydev->link || snap->speed != phydev->speed ||
+		  snap->duplex != phydev->duplex || snap->port != phydev->port;
+
+	write_seqlock(&priv->snap_lock);
+	snap->generation++;
+	snap->timestamp_ns = ktime_get_ns();
+	snap->link = phydev->link;
+	snap->speed = phydev->speed;
+	snap->duplex = phydev->duplex;
+	snap->port = phydev->port;
+	snap->pause = phydev->pause;
+	snap->asym_pause = phydev->asym_pause;
+	write_sequnlock(&priv->snap_lock);
+
+	return changed;
+}
+
+static int mars_read_status(struct phy_device *phydev)
+{
+	struct mars_priv *priv = phydev->priv;
+	ktime_t start;
+	bool acct = mars_acct_begin(phydev, MARS_CB_READ_STATUS, &start);
+	int ret, link;
+
+	link = mars_damp_begin(phydev);
+	ret = priv->ops->read_status(phydev);
+	if (ret >= 0) {
+		mars_damp_end(phydev);
+		mars_poll_update(phydev, mars_snapshot_update(phydev));
+	} else {
+		phydev->link = link;
+	}
+	if (acct)
+		mars_acct_end(phydev, MARS_CB_READ_STATUS, start);
+
+	return ret;
+}
+
+/* MARS1P is copper only: no register space switching, and the 1000BASE-T
+ * registers are only read for a gigabit link.
+ */
+static int __mars1p_read_status(struct phy_device *phydev)
+{
+	struct mars_priv *priv = phydev->priv;
+	bool was_up = phydev->link;
+	int lpa = 0, stat1000 = 0;
+	int cheap = MARS_SHADOW_UNKNOWN;
+	int val = 0, oldpage;
+
+	if (mars_poll_cheap(phydev, MARS_PORT_TYPE_UTP)) {
+		oldpage = mars_port_select(phydev, MARS_PORT_TYPE_UTP,
+					   CTC_PHY_REG_SPACE);
+		if (oldpage >= 0)
+			val = __mars_read_ssreg_link(phydev, true);
+		val = mars_port_restore(phydev, MARS_PORT_TYPE_UTP, oldpage,
+					val);
+		if (val < 0)
+			return val;
+		if (val == priv->ssreg_last)
+			return 0;
+		cheap = val;
+	}
+
+	oldpage = mars_port_select(phydev, MARS_PORT_TYPE_UTP,
+				   CTC_PHY_REG_SPACE);
+	if (oldpage < 0)
+		return oldpage;
+	/* A changed cheap reading is current, a read of the latched BMSR
+	 * after it would miss a drop
+	 */
+	val = cheap;
+	if (val == MARS_SHADOW_UNKNOWN)
+		val = __mars_read_ssreg_link(phydev, was_up);
+	if (val < 0)
+		goto out;
+
+	phydev->link = !!(val & CTC_MARS_SSREG_LINK);
+	trace_mars_link(phydev, MARS_PORT_TYPE_UTP, val, phydev->link);
+	mars_decode_ssreg(phydev, val);
+	if (!phydev->link)
+		goto out;
+
+	if (phydev->duplex == DUPLEX_FULL ||
+	    phydev->autoneg == AUTONEG_ENABLE) {
+		lpa = __mars_read(phydev, MII_LPA);
+		if (lpa < 0) {
+			val = lpa;
+			goto out;
+		}
+	}
+
+	/* Also read when a link comes up slow, for the downshift check */
+	if (phydev->speed == SPEED_1000 ||
+	    (!was_up && mars_adv_gigabit(phydev))) {
+		stat1000 = __mars_read(phydev, MII_STAT1000);
+		if (stat1000 < 0) {
+			val = stat1000;
+			goto out;
+		}
+	}
+
+out:
+	val = mars_port_restore(phydev, MARS_PORT_TYPE_UTP, oldpage, val);
+	if (val < 0)
+		return val;
+
+	if (was_up && !phydev->link)
+		priv->stats.link_flaps++;
+	if (!was_up && phydev->link)
+		mars_note_downshift(phydev, stat1000);
+
+#if (LINUX_VERSION_CODE >= KERNEL_VERSION(5, 5, 0))
+	mii_lpa_mod_linkmode_lpa_t(phydev->lp_advertising, lpa);
+	mii_stat1000_mod_linkmode_lpa_t(phydev->lp_advertising, stat1000);
+#elif (LINUX_VERSION_CODE >= KERNEL_VERSION(5, 0, 0))
+	linkmode_zero(phydev->lp_advertising);
+	mii_lpa_to_linkmode_lpa_t(phydev->lp_advertising, lpa);
+	mii_stat1000_to_linkmode_lpa_t(phydev->lp_advertising, stat1000);
+#else
+	phydev->lp_advertising = mii_lpa_to_ethtool_lpa_t(lpa) |
+				 mii_stat1000_to_ethtool_lpa_t(stat1000);
+#endif
+
+	if (phydev->duplex == DUPLEX_FULL) {
+		phydev->pause = lpa & LPA_PAUSE_CAP ? 1 : 0;
+		phydev->asym_pause = lpa & LPA_PAUSE_ASYM ? 1 : 0;
+	}
+
+	priv->ssreg_last = phydev->link ? val : MARS_SHADOW_UNKNOWN;
+	priv->poll_full = jiffies;
+
+	return 0;
+}
+
+static int mars1p_read_status(struct phy_device *phydev)
+{
+	ktime_t start;
+	bool acct = mars_acct_begin(phydev, MARS_CB_READ_STATUS, &start);
+	int ret, link;
+
+	link = mars_damp_begin(phydev);
+	ret = __mars1p_read_status(phydev);
+	if (ret >= 0) {
+		mars_damp_end(phydev);
+		mars_poll_update(phydev, mars_snapshot_update(phydev));
+	} else {
+		phydev->link = link;
+	}
+	if (acct)
+		mars_acct_end(phydev, MARS_CB_READ_STATUS, start);
+
+	return ret;
+}
+
+static int mars_config_aneg_utp(struct phy_device *phydev)
+{
+	return __mars1s_config_aneg(phydev, MARS_PORT_TYPE_UTP);
+}
+
+static int mars_config_aneg_fiber(struct phy_device *phydev)
+{
+	return __mars1s_config_aneg(phydev, MARS_PORT_TYPE_FIBER);
+}
+
+static int mars_config_aneg_combo(struct phy_device *phydev)
+{
+	int ret;
+
+	ret = __mars1s_config_aneg(phydev, MARS_PORT_TYPE_COMBO);
+	if (ret < 0)
+		return ret;
+
+	return mars_medium_power(phydev);
+}
+
+static int mars_read_status_utp(struct phy_device *phydev)
+{
+	return __mars_read_status(phydev, MARS_PORT_TYPE_UTP);
+}
+
+static int mars_read_status_fiber(struct phy_device *phydev)
+{
+	return __mars_read_status(phydev, MARS_PORT_TYPE_FIBER);
+}
+
+static int mars_read_status_combo(struct phy_device *phydev)
+{
+	return __mars_read_status(phydev, MARS_PORT_TYPE_COMBO);
+}
+
+static const struct mars_port_ops_t mars_port_ops[MARS_PORT_TYPE_MAX] = {
+	[MARS_PORT_TYPE_UTP] = {
+		.config_aneg = mars_config_aneg_utp,
+		.read_status = mars_read_status_utp,
+	},
+	[MARS_PORT_TYPE_FIBER] = {
+		.config_aneg = mars_config_aneg_fiber,
+		.read_status = mars_read_status_fiber,
+	},
+	[MARS_PORT_TYPE_COMBO] = {
+		.config_aneg = mars_config_aneg_combo,
+		.read_status = mars_read_status_combo,
+	},
+};
+
+#if (LINUX_VERSION_CODE >= KERNEL_VERSION(4, 14, 0))
+/* Internal loopback of the medium in use: copper on UTP ports, SerDes on
+ * fiber ports, the active medium on combo ports. The speed is forced while
+ * in loopback, the previous BMCR is restored on exit.
+ */
+static int __mars_set_loopback(struct phy_device *phydev, bool enable,
+			       int speed)
+{
+	struct mars_priv *priv = phydev->priv;
+	int space, ctl, oldpage;
+	int ret = 0;
+
+	if (enable)
+		space = mars_medium_space(priv->active_medium);
+	else
+		space = priv->loopback_space;
+	if (space == CTC_REG_SPACE_UNKNOWN)
+		return 0;
+
+	oldpage = mars_port_select(phydev, priv->port_type, space);
+	if (oldpage < 0)
+		goto out;
+
+	if (!enable) {
+		ctl = priv->loopback_bmcr;
+		if (ctl & BMCR_ANENABLE)
+			ctl |= BMCR_ANRESTART;
+		ret = __mars_write(phydev, MII_BMCR, ctl);
+		/* BMCR_ANRESTART is self clearing */
+		priv->bmcr[space] = (ret < 0) ? MARS_SHADOW_UNKNOWN :
+					ctl & ~BMCR_ANRESTART;
+		if (ret >= 0)
+			priv->loopback_space = CTC_REG_SPACE_UNKNOWN;
+		goto out;
+	}
+
+	ctl = __mars_bmcr_read(phydev, space);
+	if (ctl < 0) {
+		ret = ctl;
+		goto out;
+	}
+	priv->loopback_bmcr = ctl;
+
+	/* The SerDes only runs at gigabit */
+	ctl = BMCR_LOOPBACK | BMCR_FULLDPLX;
+	if (space == CTC_SDS_REG_SPACE || !speed || speed == SPEED_1000)
+		ctl |= BMCR_SPEED1000;
+	else if (speed == SPEED_100)
+		ctl |= BMCR_SPEED100;
+	else if (speed != SPEED_10)
+		ret = -EINVAL;
+	if (ret >= 0)
+		ret = __mars_bmcr_write(phydev, space, ctl);
+	if (ret >= 0)
+		priv->loopback_space = space;
+
+out:
+	return mars_port_restore(phydev, priv->port_type, oldpage, ret);
+}
+
+#if (LINUX_VERSION_CODE >= KERNEL_VERSION(6, 16, 0))
+static int mars_set_loopback(struct phy_device *phydev, bool enable,
+			     int speed)
+{
+	return __mars_set_loopback(phydev, enable, speed);
+}
+#else
+static int mars_set_loopback(struct phy_device *phydev, bool enable)
+{
+	return __mars_set_loopback(phydev, enable, 0);
+}
+#endif
+#endif
+
+static bool wol_default;
+module_param_named(wol, wol_default, bool, 0444);
+MODULE_PARM_DESC(wol,
+		 "Enable magic packet WOL at init, ethtool can change it later (default: off)");
+
+static uint wol_pulse_ms = 672;
+module_param(wol_pulse_ms, uint, 0444);
+MODULE_PARM_DESC(wol_pulse_ms,
+		 "WOL output pulse width in ms, rounded up to 84, 168, 336 or 672, 0 for a level output (default: 672)");
+
+/* WOL output type and width from a pulse width in ms, 0 for a level */
+static void mars_wol_output(struct mars_priv *priv, u32 ms)
+{
+	int width = MARS_WOL_WIDTH_84MS;
+
+	if (!ms) {
+		priv->wol_type = MARS_WOL_TYPE_LEVEL;
+		priv->wol_width = MARS_WOL_WIDTH_84MS;
+		return;
+	}
+
+	while (width < MARS_WOL_WIDTH_672MS && ms > (84U << width))
+		width++;
+	priv->wol_type = MARS_WOL_TYPE_PULSE;
+	priv->wol_width = width;
+}
+
+/* CTC_MARS_WOL_CFG_REG value for wol_cfg, the other bits are kept from val */
+static u16 mars_wol_cfg_val(u16 val, struct mars_wol_cfg_t wol_cfg)
+{
+	if (wol_cfg.enable) {
+		val |= CTC_MARS_WOL_EN;
+
+		if (wol_cfg.type == MARS_WOL_TYPE_LEVEL) {
+			val &= ~CTC_MARS_WOL_TYPE;
+			val &= ~CTC_MARS_WOL_INTR_SEL;
+		} else if (wol_cfg.type == MARS_WOL_TYPE_PULSE) {
+			val |= CTC_MARS_WOL_TYPE;
+			val |= CTC_MARS_WOL_INTR_SEL;
+
+			if (wol_cfg.width == MARS_WOL_WIDTH_84MS) {
+				val &= ~CTC_MARS_WOL_WIDTH1;
+				val &= ~CTC_MARS_WOL_WIDTH2;
+			} else if (wol_cfg.width == MARS_WOL_WIDTH_168MS) {
+				val |= CTC_MARS_WOL_WIDTH1;
+				val &= ~CTC_MARS_WOL_WIDTH2;
+			} else if (wol_cfg.width == MARS_WOL_WIDTH_336MS) {
+				val &= ~CTC_MARS_WOL_WIDTH1;
+				val |= CTC_MARS_WOL_WIDTH2;
+			} else if (wol_cfg.width == MARS_WOL_WIDTH_672MS) {
+				val |= CTC_MARS_WOL_WIDTH1;
+				val |= CTC_MARS_WOL_WIDTH2;
+			}
+		}
+	} else {
+		val &= ~CTC_MARS_WOL_EN;
+		val &= ~CTC_MARS_WOL_INTR_SEL;
+	}
+
+	return val;
+}
+
+/* Answered from the CTC_MARS_WOL_CFG_REG shadow, the register is only read
+ * when nothing was written since the last reset
+ */
+static void mars_get_wol(struct phy_device *phydev, struct ethtool_wolinfo *wol)
+{
+	struct mars_priv *priv = phydev->priv;
+	int val = 0;
+
+	wol->supported = WAKE_MAGIC;
+	wol->wolopts = 0;
+
+	val = priv->wol_cfg;
+	if (val == MARS_SHADOW_UNKNOWN) {
+		val = mars_ext_read(phydev, CTC_MARS_WOL_CFG_REG);
+		if (val < 0)
+			return;
+		priv->wol_cfg = val;
+	}
+
+	if (val & CTC_MARS_WOL_EN)
+		wol->wolopts |= WAKE_MAGIC;
+}
+
+static const u32 mars_wol_mac_regs[3] = {
+	CTC_MARS_MAGIC_PACKET_MAC_ADDR2,
+	CTC_MARS_MAGIC_PACKET_MAC_ADDR1,
+	CTC_MARS_MAGIC_PACKET_MAC_ADDR0,
+};
+
+/* The magic packet address, the WOL config and the WOL interrupt in one
+ * bus locked pass. Each register is compared with its shadow and only
+ * written when it changes, the address first so the PHY never matches a
+ * stale one.
+ */
+static int __mars_set_wol(struct phy_device *phydev,
+			  struct ethtool_wolinfo *wol)
+{
+	struct mars_priv *priv = phydev->priv;
+	struct net_device *ndev = phydev->attached_dev;
+	struct mars_wol_cfg_t wol_cfg;
+	int ret = 0, oldpage, val, i;
+	u16 mac[3] = { 0 };
+
+	if (wol->wolopts & ~WAKE_MAGIC)
+		return -EOPNOTSUPP;
+
+	memset(&wol_cfg, 0, sizeof(struct mars_wol_cfg_t));
+	wol_cfg.enable = !!(wol->wolopts & WAKE_MAGIC);
+	wol_cfg.type = priv->wol_type;
+	wol_cfg.width = priv->wol_width;
+
+	if (wol_cfg.enable) {
+		if (!ndev)
+			return -ENODEV;
+		for (i = 0; i < ARRAY_SIZE(mac); i++)
+			mac[i] = (ndev->dev_addr[2 * i] << 8) |
+				 ndev->dev_addr[2 * i + 1];
+	}
+
+	oldpage = phy_select_page(phydev, CTC_PHY_REG_SPACE);
+	if (oldpage < 0)
+		goto out;
+
+	for (i = 0; wol_cfg.enable && i < ARRAY_SIZE(mac); i++) {
+		if (priv->wol_mac[i] == mac[i])
+			continue;
+		ret = __mars_ext_write(phydev, mars_wol_mac_regs[i], mac[i]);
+		priv->wol_mac[i] = (ret < 0) ? MARS_SHADOW_UNKNOWN : mac[i];
+		if (ret < 0)
+			goto out;
+	}
+
+	val = priv->wol_cfg;
+	if (val == MARS_SHADOW_UNKNOWN) {
+		ret = __mars_ext_read(phydev, CTC_MARS_WOL_CFG_REG);
+		if (ret < 0)
+			goto out;
+		val = ret;
+	}
+	ret = mars_wol_cfg_val(val, wol_cfg);
+	if (ret != val) {
+		val = ret;
+		ret = __mars_ext_write(phydev, CTC_MARS_WOL_CFG_REG, val);
+		if (ret < 0) {
+			priv->wol_cfg = MARS_SHADOW_UNKNOWN;
+			goto out;
+		}
+	}
+	priv->wol_cfg = val;
+
+	/* The WOL interrupt shares CTC_PHY_IMASK with the link events */
+	priv->wol_irq = wol_cfg.enable;
+	ret = __mars_write_imask(phydev);
+	if (ret >= 0)
+		priv->wolopts = wol->wolopts;
+
+out:
+	return phy_restore_page(phydev, oldpage, ret);
+}
+
+static int mars_set_wol(struct phy_device *phydev, struct ethtool_wolinfo *wol)
+{
+	ktime_t start;
+	bool acct = mars_acct_begin(phydev, MARS_CB_SET_WOL, &start);
+	int ret;
+
+	ret = __mars_set_wol(phydev, wol);
+	if (acct)
+		mars_acct_end(phydev, MARS_CB_SET_WOL, start);
+
+	return ret;
+}
+
+static int mars_get_port_type(struct phy_device *phydev)
+{
+	struct mars_priv *priv = phydev->priv;
+	int val = 0;
+	int port_type = 0;
+
+	val = mars_ext_read(phydev, CTC_MARS_CHIP_CFG_REG);
+	if (val < 0)
+		return val;
+	val &= 0x7;
+
+	if (val == 0x0 || val == 0x3)
+		port_type = MARS_PORT_TYPE_UTP;
+	else if (val == 0x1 || val == 0x4 || val == 0x5)
+		port_type = MARS_PORT_TYPE_FIBER;
+	else
+		port_type = MARS_PORT_TYPE_COMBO;
+
+	priv->port_type = port_type;
+	priv->ops = &mars_port_ops[port_type];
+	if (port_type != MARS_PORT_TYPE_COMBO)
+		priv->active_medium = port_type;
+	phydev->port = (port_type == MARS_PORT_TYPE_FIBER) ?
+		PORT_FIBRE : PORT_TP;
+
+	return 0;
+}
+
+static bool pkg_checker;
+module_param_named(checker, pkg_checker, bool, 0444);
+MODULE_PARM_DESC(checker,
+		 "Copper packet checker, adds frame counters to the ethtool statistics (default: off)");
+
+static const struct mars_reg_seq_t mars1p_init_seq[] = {
+	/* RGMII clock 2.5M when link down, bit12:1->0 */
+	MARS_SEQ_EXT(CTC_PHY_REG_SPACE, 0xc, 0xffff, 0x8051),
+	/* Disable sleep mode, bit15:1->0 */
+	MARS_SEQ_EXT(CTC_PHY_REG_SPACE, 0x27, 0xffff, 0x2029),
+	/* disable PHY to respond to MDIO access with PHYAD0 */
+	/* MMD7 8001h: bit6: 0, change value: 0x7f --> 0x3f */
+	MARS_SEQ_MMD(CTC_PHY_REG_SPACE, 0x7, 0x8001, 0xffff, 0x3f),
+};
+
+static const struct mars_chip_seq_t mars_chip_seqs[] = {
+	{ CTC_PHY_ID_MARS1P, mars1p_init_seq, ARRAY_SIZE(mars1p_init_seq) },
+	{ CTC_PHY_ID_MARS1P_V1, mars1p_init_seq, ARRAY_SIZE(mars1p_init_seq) },
+};
+
+static int mars_apply_chip_seq(struct phy_device *phydev)
+{
+	int i;
+
+	for (i = 0; i < ARRAY_SIZE(mars_chip_seqs); i++) {
+		if (mars_chip_seqs[i].phy_id == phydev->drv->phy_id)
+			return mars_apply_reg_seq(phydev, mars_chip_seqs[i].seq,
+						  mars_chip_seqs[i].count);
+	}
+
+	return 0;
+}
+
+/* Hardware part of the init, also run ahead of config_init by the bus
+ * work item. Only touches the PHY and priv, never the phydev fields.
+ */
+static int mars_init_hw(struct phy_device *phydev)
+{
+	struct mars_priv *priv = phydev->priv;
+	const struct mars_reg_seq_t init_seq[] = {
+		/* Packet checker, feeds the ethtool frame counters */
+		MARS_SEQ_EXT(CTC_PHY_REG_SPACE, CTC_MARS_PKG_CFG0_REG,
+			     CTC_MARS_PKG_CHK_EN,
+			     priv->pkg_chk ? CTC_MARS_PKG_CHK_EN : 0),
+		/* Fiber link timer 2.6ms */
+		MARS_SEQ_EXT(CTC_SDS_REG_SPACE, CTC_MARS_SDS_LINK_TIMER_REG,
+			     0xffff, CTC_MARS_SDS_LINK_TIMER_DEF),
+	};
+	int val;
+	u32 features;
+
+	val = mars_apply_chip_seq(phydev);
+	if (val < 0)
+		return val;
+
+	val = mars_apply_reg_seq(phydev, init_seq, ARRAY_SIZE(init_seq));
+	if (val < 0)
+		return val;
+
+	if (!priv->stats.bringup_us)
+		priv->stats.bringup_us =
+			max_t(s64, ktime_us_delta(ktime_get(), priv->probe_time), 1);
+
+	/* The abilities don't change, only probe them once */
+	if (priv->features_valid)
+		return 0;
+
+	features = (SUPPORTED_TP | SUPPORTED_MII
+		    | SUPPORTED_AUI | SUPPORTED_FIBRE |
+		    SUPPORTED_BNC | SUPPORTED_Pause | SUPPORTED_Asym_Pause);
+
+	/* Do we support autonegotiation? */
+	val = mars_page_read(phydev, CTC_PHY_REG_SPACE, MII_BMSR);
+	if (val < 0)
+		return val;
+
+	if (val & BMSR_ANEGCAPABLE)
+		features |= SUPPORTED_Autoneg;
+
+	if (val & BMSR_100FULL)
+		features |= SUPPORTED_100baseT_Full;
+	if (val & BMSR_100HALF)
+		features |= SUPPORTED_100baseT_Half;
+	if (val & BMSR_10FULL)
+		features |= SUPPORTED_10baseT_Full;
+	if (val & BMSR_10HALF)
+		features |= SUPPORTED_10baseT_Half;
+
+	if (val & BMSR_ESTATEN) {
+		val = mars_page_read(phydev, CTC_PHY_REG_SPACE, MII_ESTATUS);
+		if (val < 0)
+			return val;
+
+		if (val & ESTATUS_1000_TFULL)
+			features |= SUPPORTED_1000baseT_Full;
+		if (val & ESTATUS_1000_THALF)
+			features |= SUPPORTED_1000baseT_Half;
+	}
+	priv->features = features;
+	priv->features_valid = true;
+
+	return 0;
+}
+
+/* Delays wanted by phy-mode and the delay properties. A plain rgmii mode
+ * without delay properties keeps the strapped delays.
+ */
+static bool mars_rgmii_delays(struct phy_device *phydev, u16 *chip_cfg,
+			      u16 *cfg1)
+{
+	struct mars_priv *priv = phydev->priv;
+	int rx_ps = 0, tx_ps = 0;
+	int rx, tx;
+
+	switch (phydev->interface) {
+	case PHY_INTERFACE_MODE_RGMII:
+		if (priv->rx_delay_ps < 0 && priv->tx_delay_ps < 0)
+			return false;
+		break;
+	case PHY_INTERFACE_MODE_RGMII_ID:
+		rx_ps = priv->rx_delay_ps;
+		tx_ps = priv->tx_delay_ps;
+		break;
+	case PHY_INTERFACE_MODE_RGMII_RXID:
+		rx_ps = priv->rx_delay_ps;
+		break;
+	case PHY_INTERFACE_MODE_RGMII_TXID:
+		tx_ps = priv->tx_delay_ps;
+		break;
+	default:
+		return false;
+	}
+	if (rx_ps < 0)
+		rx_ps = CTC_MARS_RGMII_DLY_DEF_PS;
+	if (tx_ps < 0)
+		tx_ps = CTC_MARS_RGMII_DLY_DEF_PS;
+
+	/* The RX clock delay covers most of a standard delay */
+	*chip_cfg = 0;
+	if (rx_ps >= CTC_MARS_RXC_DLY_PS) {
+		*chip_cfg = CTC_MARS_CHIP_CFG_RXC_DLY_EN;
+		rx_ps -= CTC_MARS_RXC_DLY_PS;
+	}
+	rx = min(DIV_ROUND_CLOSEST(rx_ps, CTC_MARS_RGMII_DLY_STEP_PS),
+		 CTC_MARS_RGMII_DLY_MAX);
+	tx = min(DIV_ROUND_CLOSEST(tx_ps, CTC_MARS_RGMII_DLY_STEP_PS),
+		 CTC_MARS_RGMII_DLY_MAX);
+	*cfg1 = (rx << CTC_MARS_RGMII_RX_DLY_SHIFT) |
+		(tx << CTC_MARS_RGMII_FE_TX_DLY_SHIFT) | tx;
+
+	return true;
+}
+
+/* Fixed mars_apply_settings() steps: two RGMII delay registers, EEE
+ * advertisement, LPI timer, fast link down, link timer and downshift
+ */
+#define MARS_SETTINGS_STEPS		7
+
+/* Write back the settings changed from the hardware defaults */
+static int mars_apply_settings(struct phy_device *phydev)
+{
+	struct mars_priv *priv = phydev->priv;
+	struct mars_reg_seq_t seq[MARS_SETTINGS_STEPS + MARS_SDS_TUNING_MAX];
+	u16 chip_cfg, cfg1;
+	int i, n = 0;
+
+	BUILD_BUG_ON(ARRAY_SIZE(seq) > MARS_REG_SEQ_MAX);
+
+	/* Known once the MAC is attached, config_init applies them */
+	if (mars_rgmii_delays(phydev, &chip_cfg, &cfg1)) {
+		seq[n++] = (struct mars_reg_seq_t)
+			MARS_SEQ_EXT(CTC_PHY_REG_SPACE, CTC_MARS_CHIP_CFG_REG,
+				     CTC_MARS_CHIP_CFG_RXC_DLY_EN, chip_cfg);
+		seq[n++] = (struct mars_reg_seq_t)
+			MARS_SEQ_EXT(CTC_PHY_REG_SPACE, CTC_MARS_RGMII_CFG1_REG,
+				     CTC_MARS_RGMII_DLY_MASK, cfg1);
+	}
+	for (i = 0; i < priv->sds_tuning_n; i++)
+		seq[n++] = (struct mars_reg_seq_t)
+			MARS_SEQ_EXT(CTC_SDS_REG_SPACE, priv->sds_tuning[i][0],
+				     priv->sds_tuning[i][1],
+				     priv->sds_tuning[i][2]);
+
+	if (priv->eee_adv != MARS_SHADOW_UNKNOWN)
+		seq[n++] = (struct mars_reg_seq_t)
+			MARS_SEQ_MMD(CTC_PHY_REG_SPACE, MDIO_MMD_AN,
+				     MDIO_AN_EEE_ADV, 0xffff, priv->eee_adv);
+	if (priv->lpi_timer != MARS_SHADOW_UNKNOWN)
+		seq[n++] = (struct mars_reg_seq_t)
+			MARS_SEQ_EXT(CTC_PHY_REG_SPACE, CTC_MARS_LPI_TIMER_REG,
+				     0xffff, priv->lpi_timer);
+	if (priv->fld_cfg != MARS_SHADOW_UNKNOWN)
+		seq[n++] = (struct mars_reg_seq_t)
+			MARS_SEQ_EXT(CTC_PHY_REG_SPACE, CTC_MARS_FLD_CFG_REG,
+				     0xffff, priv->fld_cfg);
+	if (priv->link_timer != MARS_SHADOW_UNKNOWN)
+		seq[n++] = (struct mars_reg_seq_t)
+			MARS_SEQ_EXT(CTC_SDS_REG_SPACE,
+				     CTC_MARS_SDS_LINK_TIMER_REG, 0xffff,
+				     priv->link_timer);
+	if (priv->smart_speed != MARS_SHADOW_UNKNOWN)
+		seq[n++] = (struct mars_reg_seq_t)
+			MARS_SEQ_EXT(CTC_PHY_REG_SPACE, CTC_MARS_SMART_SPEED_REG,
+				     CTC_MARS_SMART_SPEED_MASK,
+				     priv->smart_speed);
+
+	return mars_apply_reg_seq(phydev, seq, n);
+}
+
+static LIST_HEAD(mars_bus_inits);
+static DEFINE_MUTEX(mars_bus_init_lock);
+
+static void mars_bus_init_work(struct work_struct *work)
+{
+	struct mars_bus_init_t *bus_init =
+		container_of(work, struct mars_bus_init_t, work);
+	struct mars_priv *priv;
+	int ret;
+
+	mutex_lock(&mars_bus_init_lock);
+	while (!list_empty(&bus_init->pending)) {
+		priv = list_first_entry(&bus_init->pending, struct mars_priv,
+					init_node);
+		list_del_init(&priv->init_node);
+		bus_init->running = priv;
+		mutex_unlock(&mars_bus_init_lock);
+
+		/* config_init runs it again, just report the failure */
+		ret = mars_init_hw(priv->phydev);
+		if (ret < 0)
+			dev_warn(mars_dev(priv->phydev),
+				 "deferred init failed: %d\n", ret);
+
+		mutex_lock(&mars_bus_init_lock);
+		bus_init->running = NULL;
+		wake_up_all(&bus_init->idle);
+	}
+	mutex_unlock(&mars_bus_init_lock);
+}
+
+/* Queue the deferred init of phydev on the work item of its bus */
+static int mars_bus_init_queue(struct phy_device *phydev)
+{
+	struct mars_priv *priv = phydev->priv;
+	struct mars_bus_init_t *bus_init;
 
-		err = mars_config_advert(phydev);
-		if (err < 0)	/* error */
-			return err;
+	mutex_lock(&mars_bus_init_lock);
+	list_for_each_entry(bus_init, &mars_bus_inits, node) {
+		if (bus_init->bus == mars_bus(phydev))
+			goto found;
+	}
 
-		changed |= err;
+	bus_init = kzalloc(sizeof(*bus_init), GFP_KERNEL);
+	if (!bus_init) {
+		mutex_unlock(&mars_bus_init_lock);
+		return -ENOMEM;
+	}
+	bus_init->bus = mars_bus(phydev);
+	INIT_WORK(&bus_init->work, mars_bus_init_work);
+	INIT_LIST_HEAD(&bus_init->pending);
+	init_waitqueue_head(&bus_init->idle);
+	list_add_tail(&bus_init->node, &mars_bus_inits);
+
+found:
+	bus_init->users++;
+	priv->bus_init = bus_init;
+	list_add_tail(&priv->init_node, &bus_init->pending);
+	queue_work(system_unbound_wq, &bus_init->work);
+	mutex_unlock(&mars_bus_init_lock);
 
-		if (changed == 0) {
-			/* Advertisement hasn't changed,
-			 * but maybe aneg was never on to
-			 * begin with?  Or maybe phy was isolated?
-			 */
-			int ctl =
-			    mars_page_read(phydev, CTC_PHY_REG_SPACE, MII_BMCR);
+	return 0;
+}
 
-			if (ctl < 0)
-				return ctl;
+/* Take the deferred init of phydev back from the bus work item. When it is
+ * running only its end is waited for, not the rest of the bus.
+ */
+static void mars_bus_init_cancel(struct phy_device *phydev)
+{
+	struct mars_priv *priv = phydev->priv;
+	struct mars_bus_init_t *bus_init = priv->bus_init;
 
-			if (!(ctl & BMCR_ANENABLE) || (ctl & BMCR_ISOLATE))
-				changed = 1;	/* do restart aneg */
-		}
+	if (!bus_init)
+		return;
 
-		/* Only restart aneg if we are advertising something different
-		 * than we were before.
-		 */
-		if (changed > 0)
-			ret = mars_restart_aneg(phydev);
-		if (ret < 0)
-			return ret;
+	mutex_lock(&mars_bus_init_lock);
+	list_del_init(&priv->init_node);
+	mutex_unlock(&mars_bus_init_lock);
+
+	wait_event(bus_init->idle, READ_ONCE(bus_init->running) != priv);
+}
+
+static void mars_bus_init_put(struct phy_device *phydev)
+{
+	struct mars_priv *priv = phydev->priv;
+	struct mars_bus_init_t *bus_init = priv->bus_init;
+	bool last;
+
+	if (!bus_init)
+		return;
+
+	mars_bus_init_cancel(phydev);
+
+	mutex_lock(&mars_bus_init_lock);
+	last = !--bus_init->users;
+	if (last)
+		list_del(&bus_init->node);
+	priv->bus_init = NULL;
+	mutex_unlock(&mars_bus_init_lock);
+
+	if (last) {
+		cancel_work_sync(&bus_init->work);
+		kfree(bus_init);
 	}
+}
 
-	if (port_type == MARS_PORT_TYPE_FIBER ||
-	    port_type == MARS_PORT_TYPE_COMBO) {
-		if (phydev->autoneg != AUTONEG_ENABLE) {
-			ret = mars_setup_forced(phydev);
-			return ret;
-		}
+static int __mars_config_init(struct phy_device *phydev)
+{
+	struct mars_priv *priv = phydev->priv;
+	int val;
+	struct ethtool_wolinfo wol;
+#if (LINUX_VERSION_CODE >= KERNEL_VERSION(5, 0, 0))
+	__ETHTOOL_DECLARE_LINK_MODE_MASK(features_linkmode);
+#endif
 
-		ret = mars_restart_aneg(phydev);
-		if (ret < 0)
-			return ret;
+	/* Finish the deferred init here if the bus work item hasn't */
+	mars_bus_init_cancel(phydev);
+
+	/* The PHY may have been reset, forget the cached register state */
+	mars_reg_space_invalidate(phydev);
+	mars_shadow_invalidate(phydev);
+	/* Without a .soft_reset the checker counters keep running across
+	 * config_init, the next read takes a new baseline
+	 */
+	priv->hw_stats_valid = false;
+
+	/* Whatever a reset undid is written back, the registers the bus work
+	 * item already set up are only read
+	 */
+	val = mars_init_hw(phydev);
+	if (val < 0)
+		return val;
+
+	val = mars_apply_settings(phydev);
+	if (val < 0)
+		return val;
+
+	/* Bring the reset interrupt mask back in line with the driver state */
+	val = mars_write_imask(phydev);
+	if (val < 0)
+		return val;
+
+#if (LINUX_VERSION_CODE >= KERNEL_VERSION(5, 0, 0))
+	ethtool_convert_legacy_u32_to_link_mode(features_linkmode,
+						priv->features);
+	linkmode_and(phydev->supported, phydev->supported, features_linkmode);
+	linkmode_and(phydev->advertising, phydev->supported, features_linkmode);
+#else
+	phydev->supported &= priv->features;
+	phydev->advertising &= priv->features;
+#endif
+
+	/* A reset clears WOL, restore what set_wol or the wol parameter asked
+	 * for. The magic packet address comes from the attached device.
+	 */
+	if (priv->wolopts && phydev->attached_dev) {
+		wol.supported = WAKE_MAGIC;
+		wol.wolopts = priv->wolopts;
+		val = __mars_set_wol(phydev, &wol);
+		if (val < 0)
+			return val;
 	}
 
 	return 0;
 }
 
-static int mars_ack_interrupt(struct phy_device *phydev)
+int mars_config_init(struct phy_device *phydev)
 {
-	int err;
+	ktime_t start;
+	bool acct = mars_acct_begin(phydev, MARS_CB_CONFIG_INIT, &start);
+	int ret;
 
-	/* Clear the interrupts by reading the reg */
-	err = mars_page_read(phydev, CTC_PHY_REG_SPACE, CTC_PHY_IEVENT);
-	if (err < 0)
-		return err;
+	ret = __mars_config_init(phydev);
+	if (acct)
+		mars_acct_end(phydev, MARS_CB_CONFIG_INIT, start);
+
+	return ret;
+}
+
+/* Copper fast link down delays selectable in CTC_MARS_FLD_CFG_REG, ms */
+static const u8 mars_fld_delays[] = { 0, 5, 10, 20 };
+
+/* Copper register value for a fast link down time, the longest delay not
+ * above msecs is used.
+ */
+static int mars_fld_to_reg(u32 msecs)
+{
+	int i;
+
+	if (msecs >= ETHTOOL_PHY_FAST_LINK_DOWN_OFF)
+		return 0;
+
+	for (i = ARRAY_SIZE(mars_fld_delays) - 1; i > 0; i--)
+		if (mars_fld_delays[i] <= msecs)
+			break;
+
+	return CTC_MARS_FLD_EN | i;
+}
+
+/* SerDes link timer value for a fast link down time */
+static int mars_link_timer_to_reg(u32 msecs)
+{
+	if (msecs >= ETHTOOL_PHY_FAST_LINK_DOWN_OFF)
+		return CTC_MARS_SDS_LINK_TIMER_DEF;
+
+	return clamp_t(u32, msecs * 1000 / CTC_MARS_SDS_LINK_TIMER_UNIT_US,
+		       1, 0xffff);
+}
+
+#if (LINUX_VERSION_CODE >= KERNEL_VERSION(4, 11, 0))
+static int mars_get_downshift(struct phy_device *phydev, u8 *count)
+{
+	struct mars_priv *priv = phydev->priv;
+	const struct mars_reg_seq_t step =
+		MARS_SEQ_EXT(CTC_PHY_REG_SPACE, CTC_MARS_SMART_SPEED_REG, 0, 0);
+	u16 val;
+	int ret;
+
+	if (priv->port_type == MARS_PORT_TYPE_FIBER)
+		return -EOPNOTSUPP;
+
+	ret = mars_read_reg_seq(phydev, &step, 1, &val);
+	if (ret < 0)
+		return ret;
+
+	if (!(val & CTC_MARS_SMART_SPEED_EN))
+		*count = DOWNSHIFT_DEV_DISABLE;
+	else
+		*count = ((val & CTC_MARS_SMART_SPEED_RETRY_MASK) >>
+			  CTC_MARS_SMART_SPEED_RETRY_SHIFT) + 1;
 
 	return 0;
 }
 
-static int mars_config_intr(struct phy_device *phydev)
+static int mars_set_downshift(struct phy_device *phydev, const u8 *count)
 {
-	int err;
+	struct mars_priv *priv = phydev->priv;
+	int old = priv->smart_speed;
+	u8 cnt = *count;
+	int ret;
+
+	if (priv->port_type == MARS_PORT_TYPE_FIBER)
+		return -EOPNOTSUPP;
 
-	if (phydev->interrupts == PHY_INTERRUPT_ENABLED)
-		err =
-		    mars_page_write(phydev, CTC_PHY_REG_SPACE, CTC_PHY_IMASK,
-				    CTC_PHY_IMASK_INIT);
+	if (cnt == DOWNSHIFT_DEV_DEFAULT_COUNT)
+		cnt = CTC_MARS_DOWNSHIFT_DEF_COUNT;
+	if (cnt > CTC_MARS_DOWNSHIFT_MAX_COUNT)
+		return -EINVAL;
+
+	if (cnt == DOWNSHIFT_DEV_DISABLE)
+		priv->smart_speed = 0;
 	else
-		err =
-		    mars_page_write(phydev, CTC_PHY_REG_SPACE, CTC_PHY_IMASK,
-				    CTC_PHY_IMASK_CLEAR);
-	return err;
+		priv->smart_speed = CTC_MARS_SMART_SPEED_EN |
+			((cnt - 1) << CTC_MARS_SMART_SPEED_RETRY_SHIFT);
+
+	ret = mars_apply_settings(phydev);
+	if (ret < 0 || old == priv->smart_speed ||
+	    phydev->autoneg != AUTONEG_ENABLE)
+		return ret;
+
+	/* Takes effect with the next copper negotiation */
+	return __mars_restart_aneg(phydev, priv->port_type,
+				   BIT(CTC_PHY_REG_SPACE));
 }
 
-static int mars_update_link(struct phy_device *phydev, int *port_status)
+#if (LINUX_VERSION_CODE >= KERNEL_VERSION(5, 3, 0))
+/* Copper ports report the copper delay, fiber-only ports the link timer */
+static int mars_get_fld(struct phy_device *phydev, u8 *msecs)
 {
-	int ret, status;
+	struct mars_priv *priv = phydev->priv;
+	struct mars_reg_seq_t step;
+	u16 val;
+	int ret;
 
-	/* Do a fake read */
-	status = mars_page_read(phydev, CTC_PHY_REG_SPACE, MII_BMSR);
-	if (status < 0)
-		return status;
+	if (priv->port_type == MARS_PORT_TYPE_FIBER)
+		step = (struct mars_reg_seq_t)
+			MARS_SEQ_EXT(CTC_SDS_REG_SPACE,
+				     CTC_MARS_SDS_LINK_TIMER_REG, 0, 0);
+	else
+		step = (struct mars_reg_seq_t)
+			MARS_SEQ_EXT(CTC_PHY_REG_SPACE, CTC_MARS_FLD_CFG_REG,
+				     0, 0);
 
-	/* Read link and autonegotiation status */
-	status = mars_page_read(phydev, CTC_PHY_REG_SPACE, MII_BMSR);
-	if (status < 0)
-		return status;
+	ret = mars_read_reg_seq(phydev, &step, 1, &val);
+	if (ret < 0)
+		return ret;
 
-	if ((status & BMSR_LSTATUS) == 0) {
-		phydev->link = 0;
-	} else {
-		phydev->link = 1;
-		ret = mars_select_reg_space(phydev, CTC_PHY_REG_SPACE);
+	if (priv->port_type == MARS_PORT_TYPE_FIBER)
+		*msecs = min_t(u32, val * CTC_MARS_SDS_LINK_TIMER_UNIT_US / 1000,
+			       ETHTOOL_PHY_FAST_LINK_DOWN_OFF - 1);
+	else if (!(val & CTC_MARS_FLD_EN))
+		*msecs = ETHTOOL_PHY_FAST_LINK_DOWN_OFF;
+	else
+		*msecs = mars_fld_delays[val & CTC_MARS_FLD_DELAY_MASK];
+
+	return 0;
+}
+
+/* Applies to every medium of the port */
+static int mars_set_fld(struct phy_device *phydev, const u8 *msecs)
+{
+	struct mars_priv *priv = phydev->priv;
+
+	if (priv->port_type != MARS_PORT_TYPE_FIBER)
+		priv->fld_cfg = mars_fld_to_reg(*msecs);
+	if (priv->port_type != MARS_PORT_TYPE_UTP)
+		priv->link_timer = mars_link_timer_to_reg(*msecs);
+
+	return mars_apply_settings(phydev);
+}
+#endif
+
+static int mars_get_tunable(struct phy_device *phydev,
+			    struct ethtool_tunable *tuna, void *data)
+{
+	switch (tuna->id) {
+	case ETHTOOL_PHY_DOWNSHIFT:
+		return mars_get_downshift(phydev, data);
+#if (LINUX_VERSION_CODE >= KERNEL_VERSION(5, 3, 0))
+	case ETHTOOL_PHY_FAST_LINK_DOWN:
+		return mars_get_fld(phydev, data);
+#endif
+	default:
+		return -EOPNOTSUPP;
+	}
+}
+
+static int mars_set_tunable(struct phy_device *phydev,
+			    struct ethtool_tunable *tuna, const void *data)
+{
+	switch (tuna->id) {
+	case ETHTOOL_PHY_DOWNSHIFT:
+		return mars_set_downshift(phydev, data);
+#if (LINUX_VERSION_CODE >= KERNEL_VERSION(5, 3, 0))
+	case ETHTOOL_PHY_FAST_LINK_DOWN:
+		return mars_set_fld(phydev, data);
+#endif
+	default:
+		return -EOPNOTSUPP;
+	}
+}
+#endif
+
+/* Board settings from the device tree node of the PHY */
+static void mars_parse_dt(struct phy_device *phydev)
+{
+	struct device_node *np = mars_dev(phydev)->of_node;
+	struct mars_priv *priv = phydev->priv;
+	u32 tuning[MARS_SDS_TUNING_MAX * 3];
+	const char *policy;
+	u32 val, damp[4];
+	int i, ret;
+
+	if (!np)
+		return;
+
+	if (!of_property_read_u32(np, "rx-internal-delay-ps", &val))
+		priv->rx_delay_ps = val;
+	if (!of_property_read_u32(np, "tx-internal-delay-ps", &val))
+		priv->tx_delay_ps = val;
+
+	/* <reg mask val> triplets written to the SDS extended space */
+	ret = of_property_count_u32_elems(np, "ctc,serdes-tuning");
+	if (ret > 0) {
+		if (ret % 3 || ret > ARRAY_SIZE(tuning) ||
+		    of_property_read_u32_array(np, "ctc,serdes-tuning",
+					       tuning, ret)) {
+			dev_warn(mars_dev(phydev),
+				 "invalid ctc,serdes-tuning, ignored\n");
+		} else {
+			for (i = 0; i < ret; i++)
+				priv->sds_tuning[i / 3][i % 3] = tuning[i];
+			priv->sds_tuning_n = ret / 3;
+		}
+	}
+
+	if (!of_property_read_string(np, "ctc,medium-policy", &policy)) {
+		ret = mars_medium_policy_parse(policy);
+		if (ret >= 0)
+			priv->medium_policy = ret;
+		else
+			dev_warn(mars_dev(phydev), "unknown medium policy %s\n",
+				 policy);
+	}
+
+	if (!of_property_read_u32(np, "ctc,fast-link-down-copper-ms", &val))
+		priv->fld_cfg = mars_fld_to_reg(val);
+	if (!of_property_read_u32(np, "ctc,fast-link-down-fiber-ms", &val))
+		priv->link_timer = mars_link_timer_to_reg(val);
+	if (!of_property_read_u32(np, "ctc,irq-mask", &val))
+		priv->irq_events = val & CTC_PHY_IEVENT_LINK_MASK;
+	if (!of_property_read_u32(np, "ctc,wol-pulse-ms", &val))
+		mars_wol_output(priv, val);
+	/* <penalty half-life-ms suppress reuse> */
+	if (!of_property_read_u32_array(np, "ctc,flap-damping", damp, 4) &&
+	    mars_damp_valid(damp[0], damp[1], damp[2], damp[3])) {
+		priv->damp.penalty = damp[0];
+		priv->damp.half_life_ms = damp[1];
+		priv->damp.suppress = damp[2];
+		priv->damp.reuse = damp[3];
+	}
+}
+
+static const struct mars_reg_seq_t mars_hw_stat_regs[MARS_HW_STAT_REG_MAX] = {
+	[MARS_HW_PCS_STAT1] =
+		MARS_SEQ_MMD(CTC_PHY_REG_SPACE, MDIO_MMD_PCS, MDIO_STAT1, 0, 0),
+	[MARS_HW_EEE_WAKE_ERR] =
+		MARS_SEQ_MMD(CTC_PHY_REG_SPACE, MDIO_MMD_PCS,
+			     MDIO_PCS_EEE_WK_ERR, 0, 0),
+	[MARS_HW_RX_ERR] =
+		MARS_SEQ_EXT(CTC_PHY_REG_SPACE, CTC_MARS_PKG_RX_ERR, 0, 0),
+	[MARS_HW_TX_ERR] =
+		MARS_SEQ_EXT(CTC_PHY_REG_SPACE, CTC_MARS_PKG_TX_ERR, 0, 0),
+	[MARS_HW_RX_GOOD_HI] =
+		MARS_SEQ_EXT(CTC_PHY_REG_SPACE, CTC_MARS_PKG_RX_GOOD_HI, 0, 0),
+	[MARS_HW_RX_GOOD_LO] =
+		MARS_SEQ_EXT(CTC_PHY_REG_SPACE, CTC_MARS_PKG_RX_GOOD_LO, 0, 0),
+	[MARS_HW_TX_GOOD_HI] =
+		MARS_SEQ_EXT(CTC_PHY_REG_SPACE, CTC_MARS_PKG_TX_GOOD_HI, 0, 0),
+	[MARS_HW_TX_GOOD_LO] =
+		MARS_SEQ_EXT(CTC_PHY_REG_SPACE, CTC_MARS_PKG_TX_GOOD_LO, 0, 0),
+	[MARS_HW_RX_GOOD_HI2] =
+		MARS_SEQ_EXT(CTC_PHY_REG_SPACE, CTC_MARS_PKG_RX_GOOD_HI, 0, 0),
+	[MARS_HW_TX_GOOD_HI2] =
+		MARS_SEQ_EXT(CTC_PHY_REG_SPACE, CTC_MARS_PKG_TX_GOOD_HI, 0, 0),
+};
+
+static const struct mars_stat_desc_t mars_stat_descs[] = {
+	MARS_STAT("phy_rx_good_frames", rx_good),
+	MARS_STAT("phy_rx_error_frames", rx_err),
+	MARS_STAT("phy_tx_good_frames", tx_good),
+	MARS_STAT("phy_tx_error_frames", tx_err),
+	MARS_STAT("mdio_ops", mdio_ops),
+	MARS_STAT("page_switches", page_switches),
+	MARS_STAT("page_switches_saved", reg_space_saved),
+	MARS_STAT("link_flaps", link_flaps),
+	MARS_STAT("medium_switches", medium_switches),
+	MARS_STAT("interrupts", interrupts),
+	MARS_STAT("irq_link_up", irq_link_up),
+	MARS_STAT("irq_link_down", irq_link_down),
+	MARS_STAT("irq_speed_change", irq_speed_chg),
+	MARS_STAT("irq_wol", irq_wol),
+	MARS_STAT("bringup_us", bringup_us),
+	MARS_STAT("eee_rx_lpi_periods", eee_rx_lpi),
+	MARS_STAT("eee_tx_lpi_periods", eee_tx_lpi),
+	MARS_STAT("eee_wake_errors", eee_wake_err),
+	MARS_STAT("downshifts", downshifts),
+	MARS_STAT("irq_storms", irq_storms),
+	MARS_STAT("irq_rate", irq_rate),
+	MARS_STAT("flap_penalty", flap_penalty),
+	MARS_STAT("flap_suppressed", flap_suppressed),
+	MARS_STAT("flap_suppressions", flap_suppressions),
+	MARS_STAT("flap_held_ups", flap_held_ups),
+};
+
+/* Wrap safe difference of a counter split over two registers */
+static u32 mars_hw_stat_delta32(const u16 *now, const u16 *last, int hi)
+{
+	u32 cur = ((u32)now[hi] << 16) | now[hi + 1];
+	u32 old = ((u32)last[hi] << 16) | last[hi + 1];
+
+	return cur - old;
+}
+
+/* The checker only sees the copper side, fiber ports don't report it */
+static int mars_stat_first(struct phy_device *phydev)
+{
+	struct mars_priv *priv = phydev->priv;
+
+	return (priv->port_type == MARS_PORT_TYPE_FIBER || !priv->pkg_chk) ?
+		MARS_HW_STAT_DESCS : 0;
+}
+
+/* Fold the EEE and packet checker counters into the 64 bit totals. All
+ * counters are read in one batch, at most every MARS_HW_STATS_MIN_MS, the
+ * checker ones only when it is enabled. The halves of a good frame
+ * counter aren't latched, they alone are read again while a high half
+ * changes under its low half: the EEE registers clear on read and are
+ * added up from the first read. The first read after config_init only
+ * takes the checker baseline.
+ */
+static int mars_update_hw_stats(struct phy_device *phydev)
+{
+	struct mars_priv *priv = phydev->priv;
+	u16 vals[MARS_HW_STAT_REG_MAX];
+	u16 *last = priv->hw_stats_last;
+	int ret, tries = 1;
+
+	/* All of them are copper side registers */
+	if (priv->port_type == MARS_PORT_TYPE_FIBER)
+		return 0;
+
+	if (priv->hw_stats_valid &&
+	    time_before(jiffies, priv->hw_stats_jiffies +
+			msecs_to_jiffies(MARS_HW_STATS_MIN_MS)))
+		return 0;
+
+	ret = mars_read_reg_seq(phydev, mars_hw_stat_regs,
+				priv->pkg_chk ? MARS_HW_STAT_REG_MAX :
+				MARS_HW_RX_ERR, vals);
+	if (ret < 0)
+		return ret;
+
+	if (vals[MARS_HW_PCS_STAT1] & MDIO_PCS_STAT1_RXLPIR)
+		priv->stats.eee_rx_lpi++;
+	if (vals[MARS_HW_PCS_STAT1] & MDIO_PCS_STAT1_TXLPIR)
+		priv->stats.eee_tx_lpi++;
+	priv->stats.eee_wake_err += vals[MARS_HW_EEE_WAKE_ERR];
+
+	if (!priv->pkg_chk) {
+		priv->hw_stats_valid = true;
+		priv->hw_stats_jiffies = jiffies;
+		return 0;
+	}
+
+	/* The checker baseline is kept, nothing is lost on -EAGAIN */
+	while (vals[MARS_HW_RX_GOOD_HI] != vals[MARS_HW_RX_GOOD_HI2] ||
+	       vals[MARS_HW_TX_GOOD_HI] != vals[MARS_HW_TX_GOOD_HI2]) {
+		if (tries++ == MARS_HW_STATS_TRIES)
+			return -EAGAIN;
+		ret = mars_read_reg_seq(phydev,
+					&mars_hw_stat_regs[MARS_HW_RX_GOOD_HI],
+					MARS_HW_STAT_REG_MAX - MARS_HW_RX_GOOD_HI,
+					&vals[MARS_HW_RX_GOOD_HI]);
 		if (ret < 0)
 			return ret;
+	}
 
-		*port_status = MARS_PORT_TYPE_UTP;
-		return 0;
+	if (priv->hw_stats_valid) {
+		priv->stats.rx_good += mars_hw_stat_delta32(vals, last,
+							    MARS_HW_RX_GOOD_HI);
+		priv->stats.tx_good += mars_hw_stat_delta32(vals, last,
+							    MARS_HW_TX_GOOD_HI);
+		priv->stats.rx_err += (u16)(vals[MARS_HW_RX_ERR] -
+					    last[MARS_HW_RX_ERR]);
+		priv->stats.tx_err += (u16)(vals[MARS_HW_TX_ERR] -
+					    last[MARS_HW_TX_ERR]);
 	}
 
-	/* Do a fake read */
-	status = mars_page_read(phydev, CTC_SDS_REG_SPACE, MII_BMSR);
-	if (status < 0)
-		return status;
+	memcpy(last, vals, sizeof(vals));
+	priv->hw_stats_valid = true;
+	priv->hw_stats_jiffies = jiffies;
 
-	/* Read link and autonegotiation status */
-	status = mars_page_read(phydev, CTC_SDS_REG_SPACE, MII_BMSR);
-	if (status < 0)
-		return status;
+	return 0;
+}
+
+static int mars_get_sset_count(struct phy_device *phydev)
+{
+	return ARRAY_SIZE(mars_stat_descs) - mars_stat_first(phydev);
+}
+
+static void mars_get_strings(struct phy_device *phydev, u8 *data)
+{
+	int i, first = mars_stat_first(phydev);
+
+	for (i = first; i < ARRAY_SIZE(mars_stat_descs); i++)
+		strscpy(data + (i - first) * ETH_GSTRING_LEN,
+			mars_stat_descs[i].name, ETH_GSTRING_LEN);
+}
+
+static void mars_get_stats(struct phy_device *phydev,
+			   struct ethtool_stats *stats, u64 *data)
+{
+	struct mars_priv *priv = phydev->priv;
+	int i, first = mars_stat_first(phydev);
+
+	/* On error report the totals gathered so far */
+	mars_update_hw_stats(phydev);
+
+	for (i = first; i < ARRAY_SIZE(mars_stat_descs); i++)
+		data[i - first] = *(u64 *)((u8 *)&priv->stats +
+					   mars_stat_descs[i].offset);
+}
+
+static ssize_t eee_lpi_timer_us_show(struct device *dev,
+				     struct device_attribute *attr, char *buf)
+{
+	struct phy_device *phydev = to_phy_device(dev);
+	const struct mars_reg_seq_t step =
+		MARS_SEQ_EXT(CTC_PHY_REG_SPACE, CTC_MARS_LPI_TIMER_REG, 0, 0);
+	u16 val;
+	int ret;
+
+	ret = mars_read_reg_seq(phydev, &step, 1, &val);
+	if (ret < 0)
+		return ret;
+
+	return sprintf(buf, "%u\n", val);
+}
+
+static ssize_t eee_lpi_timer_us_store(struct device *dev,
+				      struct device_attribute *attr,
+				      const char *buf, size_t count)
+{
+	struct phy_device *phydev = to_phy_device(dev);
+	struct mars_priv *priv = phydev->priv;
+	u16 val;
+	int ret;
+
+	ret = kstrtou16(buf, 0, &val);
+	if (ret < 0)
+		return ret;
+
+	priv->lpi_timer = val;
+	ret = mars_apply_settings(phydev);
+	if (ret < 0)
+		return ret;
+
+	return count;
+}
+static DEVICE_ATTR_RW(eee_lpi_timer_us);
+
+/* "penalty half_life_ms suppress reuse", a zero penalty disables damping */
+static ssize_t flap_damping_show(struct device *dev,
+				 struct device_attribute *attr, char *buf)
+{
+	struct phy_device *phydev = to_phy_device(dev);
+	struct mars_priv *priv = phydev->priv;
+
+	return sprintf(buf, "%u %u %u %u\n", priv->damp.penalty,
+		       priv->damp.half_life_ms, priv->damp.suppress,
+		       priv->damp.reuse);
+}
+
+static ssize_t flap_damping_store(struct device *dev,
+				  struct device_attribute *attr,
+				  const char *buf, size_t count)
+{
+	struct phy_device *phydev = to_phy_device(dev);
+	struct mars_priv *priv = phydev->priv;
+	u32 penalty, half_life_ms, suppress, reuse;
+
+	if (sscanf(buf, "%u %u %u %u", &penalty, &half_life_ms, &suppress,
+		   &reuse) != 4)
+		return -EINVAL;
+	if (!mars_damp_valid(penalty, half_life_ms, suppress, reuse))
+		return -EINVAL;
+
+	/* Serialized against read_status, a new setting starts afresh */
+	mutex_lock(&phydev->lock);
+	priv->damp.penalty = penalty;
+	priv->damp.half_life_ms = half_life_ms;
+	priv->damp.suppress = suppress;
+	priv->damp.reuse = reuse;
+	priv->damp.figure = 0;
+	priv->damp.stamp = jiffies;
+	priv->damp.suppressed = false;
+	mutex_unlock(&phydev->lock);
+
+	/* A held link is reported at the next status read */
+	phy_trigger_machine(phydev);
+
+	return count;
+}
+static DEVICE_ATTR_RW(flap_damping);
+
+/* Combo port medium policy, one of mars_medium_policy_names. fiber-only
+ * and copper-only power the other medium down, prefer-fiber and
+ * prefer-copper only pick the medium probed first: with both linked the
+ * chip still resolves the combo on its own.
+ */
+static ssize_t medium_policy_show(struct device *dev,
+				  struct device_attribute *attr, char *buf)
+{
+	struct phy_device *phydev = to_phy_device(dev);
+	struct mars_priv *priv = phydev->priv;
+
+	return sprintf(buf, "%s\n",
+		       mars_medium_policy_names[priv->medium_policy]);
+}
+
+static ssize_t medium_policy_store(struct device *dev,
+				   struct device_attribute *attr,
+				   const char *buf, size_t count)
+{
+	struct phy_device *phydev = to_phy_device(dev);
+	struct mars_priv *priv = phydev->priv;
+	int policy, ret;
+
+	if (priv->port_type != MARS_PORT_TYPE_COMBO)
+		return -EOPNOTSUPP;
+
+	policy = mars_medium_policy_parse(buf);
+	if (policy < 0)
+		return policy;
+
+	mutex_lock(&phydev->lock);
+	priv->medium_policy = policy;
+	priv->idle_polls = 0;
+	/* A suspended PHY is set up by the config_aneg after resume */
+	ret = phydev->suspended ? 0 : mars_medium_power(phydev);
+	mutex_unlock(&phydev->lock);
+	if (ret < 0)
+		return ret;
+
+	/* Pick the medium now rather than at the next poll */
+	phy_trigger_machine(phydev);
+
+	return count;
+}
+static DEVICE_ATTR_RW(medium_policy);
+
+/* Snapshot of the last status read, costs no MDIO access */
+static ssize_t link_state_show(struct device *dev,
+			       struct device_attribute *attr, char *buf)
+{
+	struct phy_device *phydev = to_phy_device(dev);
+	struct mars_priv *priv = phydev->priv;
+	struct mars_snapshot_t snap;
+	unsigned int seq;
+
+	do {
+		seq = read_seqbegin(&priv->snap_lock);
+		snap = priv->snap;
+	} while (read_seqretry(&priv->snap_lock, seq));
+
+	return sprintf(buf,
+		       "generation %llu\ntimestamp_ns %lld\nlink %d\nspeed %d\n"
+		       "duplex %s\nport %s\npause %d\nasym_pause %d\n",
+		       snap.generation, snap.timestamp_ns, snap.link,
+		       snap.speed,
+		       snap.duplex == DUPLEX_FULL ? "full" :
+		       snap.duplex == DUPLEX_HALF ? "half" : "unknown",
+		       snap.port == PORT_FIBRE ? "fibre" : "tp",
+		       snap.pause, snap.asym_pause);
+}
+static DEVICE_ATTR_RO(link_state);
+
+/* Current polling period and regime, 0 when interrupt driven */
+static ssize_t poll_interval_ms_show(struct device *dev,
+				     struct device_attribute *attr, char *buf)
+{
+	struct phy_device *phydev = to_phy_device(dev);
+	struct mars_priv *priv = phydev->priv;
+	int mode = mars_poll_mode(priv);
+
+	if (phydev->irq != PHY_POLL)
+		return sprintf(buf, "0 interrupt\n");
+
+	return sprintf(buf, "%u %s\n",
+		       mode == MARS_POLL_FAST ? READ_ONCE(poll_fast_ms) :
+		       MARS_POLL_PHYLIB_MS, mars_poll_mode_names[mode]);
+}
+static DEVICE_ATTR_RO(poll_interval_ms);
+
+static struct attribute *mars_attrs[] = {
+	&dev_attr_eee_lpi_timer_us.attr,
+	&dev_attr_flap_damping.attr,
+	&dev_attr_medium_policy.attr,
+	&dev_attr_link_state.attr,
+	&dev_attr_poll_interval_ms.attr,
+	NULL
+};
+
+static const struct attribute_group mars_attr_group = {
+	.attrs = mars_attrs,
+};
+
+#ifdef MARS_DEBUGFS
+/* Read unlocked, a callback accounted meanwhile may show half updated */
+static int mars_acct_show(struct seq_file *m, void *v)
+{
+	struct mars_priv *priv = m->private;
+	struct mars_acct_t *acct;
+	int cb, i;
+
+	for (cb = 0; cb < MARS_CB_MAX; cb++) {
+		acct = &priv->acct[cb];
+		seq_printf(m, "%s: calls %llu std %llu ext %llu page %llu\n",
+			   mars_cb_names[cb], acct->calls,
+			   acct->frames[MARS_FRAME_STD],
+			   acct->frames[MARS_FRAME_EXT],
+			   acct->frames[MARS_FRAME_PAGE]);
+		/* Bucket n holds the calls that took less than 2^n us */
+		seq_puts(m, "  latency_log2_us:");
+		for (i = 0; i < MARS_ACCT_BUCKETS; i++)
+			seq_printf(m, " %llu", acct->hist[i]);
+		seq_putc(m, '\n');
+		seq_printf(m, "  max_frames %u\n", acct->max_frames);
+	}
+
+	return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(mars_acct);
+
+/* Binary register dump: a header followed by count entries. Entries
+ * describe themselves, type is a mars_reg_type_e. Everything is little
+ * endian, bump MARS_REGS_VERSION on any layout change.
+ */
+#define MARS_REGS_MAGIC			0x5352414d	/* "MARS" */
+#define MARS_REGS_VERSION		1
+
+struct mars_regs_hdr_t {
+	__le32 magic;
+	__le16 version;
+	__le16 count;
+	__le32 phy_id;
+	__le16 port_type;
+	__le16 reserved;
+} __packed;
+
+struct mars_regs_entry_t {
+	u8 space;
+	u8 type;
+	__le16 reg;
+	__le16 val;
+	__le16 reserved;
+} __packed;
+
+/* Standard registers with read side effects, left out of the dump: the
+ * latched low link bit of MII_BMSR would hide a drop from read_status.
+ * The extended window is dumped by address instead.
+ */
+#define MARS_REGS_STD_SKIP	(BIT(MII_BMSR) | BIT(MII_MMD_DATA) | \
+				 BIT(CTC_PHY_IEVENT) | BIT(0x1e) | BIT(0x1f))
+
+static const u16 mars_regs_ext_utp[] = {
+	0x0c, CTC_MARS_SMART_SPEED_REG, 0x27, CTC_MARS_FLD_CFG_REG,
+	CTC_MARS_LPI_TIMER_REG, CTC_MARS_PKG_CFG0_REG,
+	CTC_MARS_PKG_RX_GOOD_HI, CTC_MARS_PKG_RX_GOOD_LO, CTC_MARS_PKG_RX_ERR,
+	CTC_MARS_PKG_TX_GOOD_HI, CTC_MARS_PKG_TX_GOOD_LO, CTC_MARS_PKG_TX_ERR,
+	CTC_MARS_CHIP_CFG_REG, CTC_MARS_MAGIC_PACKET_MAC_ADDR2,
+	CTC_MARS_MAGIC_PACKET_MAC_ADDR1, CTC_MARS_MAGIC_PACKET_MAC_ADDR0,
+	CTC_MARS_WOL_CFG_REG,
+};
+
+static const u16 mars_regs_ext_sds[] = {
+	CTC_MARS_SDS_LINK_TIMER_REG,
+};
 
-	if ((status & BMSR_LSTATUS) == 0) {
-		phydev->link = 0;
-	} else {
-		phydev->link = 1;
-		ret = mars_select_reg_space(phydev, CTC_SDS_REG_SPACE);
-		if (ret < 0)
-			return ret;
+#define MARS_REGS_MAX \
+	(2 * 32 + ARRAY_SIZE(mars_regs_ext_utp) + ARRAY_SIZE(mars_regs_ext_sds))
 
-		*port_status = MARS_PORT_TYPE_FIBER;
-		return 0;
-	}
+struct mars_regs_buf_t {
+	size_t len;
+	struct mars_regs_hdr_t hdr;
+	struct mars_regs_entry_t ent[MARS_REGS_MAX];
+} __packed;
 
-	return 0;
+static void mars_regs_add(struct mars_regs_entry_t *ent, int space, int type,
+			  u16 reg, u16 val)
+{
+	ent->space = space;
+	ent->type = type;
+	ent->reg = cpu_to_le16(reg);
+	ent->val = cpu_to_le16(val);
+	ent->reserved = 0;
 }
 
-static int mars_read_status(struct phy_device *phydev)
+/* Read every space in one locked pass, each space is selected once.
+ * Returns the number of entries filled.
+ */
+static int mars_regs_dump(struct phy_device *phydev,
+			  struct mars_regs_entry_t *ent)
 {
-	int val = 0;
+	struct mars_priv *priv = phydev->priv;
+	const u16 *ext;
+	int space, i, n, val, oldpage;
+	int count = 0;
 	int ret = 0;
-	int lpa, page;
-	int port_type = 0;
-	int port_status = 0;
-
-	port_type = *(int*)phydev->priv;
 
-	if (port_type == MARS_PORT_TYPE_COMBO) {
-		/* Update the link, but return if there was an error */
-		ret = mars_update_link(phydev, &port_status);
-		if (ret < 0)
-			return ret;
-	} else
-		port_status = port_type;
+	oldpage = phy_select_page(phydev, CTC_PHY_REG_SPACE);
+	if (oldpage < 0)
+		goto out;
 
-	if (port_status)
-		page = CTC_SDS_REG_SPACE;
-	else
-		page = CTC_PHY_REG_SPACE;
+	for (space = CTC_PHY_REG_SPACE; space <= CTC_SDS_REG_SPACE; space++) {
+		/* Copper only ports have no SerDes to dump */
+		if (space == CTC_SDS_REG_SPACE &&
+		    priv->port_type == MARS_PORT_TYPE_UTP)
+			break;
 
-	phydev->speed = SPEED_10;
-	phydev->duplex = DUPLEX_HALF;
-	phydev->pause = 0;
-	phydev->asym_pause = 0;
+		ret = mars_write_page(phydev, space);
+		if (ret < 0)
+			goto out;
+
+		for (i = 0; i < 32; i++) {
+			if (MARS_REGS_STD_SKIP & BIT(i))
+				continue;
+			val = __mars_read(phydev, i);
+			if (val < 0) {
+				ret = val;
+				goto out;
+			}
+			mars_regs_add(&ent[count++], space, MARS_REG_TYPE_STD,
+				      i, val);
+		}
 
-	val = mars_page_read(phydev, page, CTC_MARS_SSREG);
-	if (val < 0)
-		return val;
+		if (space == CTC_PHY_REG_SPACE) {
+			ext = mars_regs_ext_utp;
+			n = ARRAY_SIZE(mars_regs_ext_utp);
+		} else {
+			ext = mars_regs_ext_sds;
+			n = ARRAY_SIZE(mars_regs_ext_sds);
+		}
+		for (i = 0; i < n; i++) {
+			val = __mars_ext_read(phydev, ext[i]);
+			if (val < 0) {
+				ret = val;
+				goto out;
+			}
+			mars_regs_add(&ent[count++], space, MARS_REG_TYPE_EXT,
+				      ext[i], val);
+		}
+	}
+	ret = count;
 
-	lpa = mars_page_read(phydev, page, MII_LPA);
-	if (lpa < 0)
-		return lpa;
+out:
+	return phy_restore_page(phydev, oldpage, ret);
+}
 
-	if (val & 0x8000) {
-		phydev->speed = SPEED_1000;
-		phydev->duplex = DUPLEX_FULL;
-	} else if (val & 0x4000) {
-		phydev->speed = SPEED_100;
-		if (val & 0x2000)
-			phydev->duplex = DUPLEX_FULL;
-	} else if (val & 0x2000) {
-		phydev->duplex = DUPLEX_FULL;
+/* The dump is taken at open, reads return a consistent snapshot */
+static int mars_regs_open(struct inode *inode, struct file *file)
+{
+	struct mars_priv *priv = inode->i_private;
+	struct phy_device *phydev = priv->phydev;
+	struct mars_regs_buf_t *buf;
+	int count;
+
+	buf = kmalloc(sizeof(*buf), GFP_KERNEL);
+	if (!buf)
+		return -ENOMEM;
+
+	count = mars_regs_dump(phydev, buf->ent);
+	if (count < 0) {
+		kfree(buf);
+		return count;
 	}
 
-	if (phydev->duplex == DUPLEX_FULL) {
-		phydev->pause = lpa & LPA_PAUSE_CAP ? 1 : 0;
-		phydev->asym_pause = lpa & LPA_PAUSE_ASYM ? 1 : 0;
-	}
+	buf->hdr.magic = cpu_to_le32(MARS_REGS_MAGIC);
+	buf->hdr.version = cpu_to_le16(MARS_REGS_VERSION);
+	buf->hdr.count = cpu_to_le16(count);
+	buf->hdr.phy_id = cpu_to_le32(phydev->phy_id);
+	buf->hdr.port_type = cpu_to_le16(priv->port_type);
+	buf->hdr.reserved = 0;
+	buf->len = sizeof(buf->hdr) + count * sizeof(buf->ent[0]);
+	file->private_data = buf;
 
 	return 0;
 }
 
-static int mars_set_link_timer_2_6ms(struct phy_device *phydev)
+static ssize_t mars_regs_read(struct file *file, char __user *ubuf,
+			      size_t len, loff_t *ppos)
 {
-	int ret = 0;
+	struct mars_regs_buf_t *buf = file->private_data;
 
-	ret = mars_page_ext_write(phydev, CTC_SDS_REG_SPACE, 0xa5, 0x5);
-
-	return ret;
+	return simple_read_from_buffer(ubuf, len, ppos, &buf->hdr, buf->len);
 }
 
-static int mars_wol_en_cfg(struct phy_device *phydev,
-			   struct mars_wol_cfg_t wol_cfg)
+static int mars_regs_release(struct inode *inode, struct file *file)
 {
-	int ret = 0;
-	int val = 0;
+	kfree(file->private_data);
 
-	val = mars_ext_read(phydev, CTC_MARS_WOL_CFG_REG);
-	if (val < 0)
-		return val;
+	return 0;
+}
 
-	if (wol_cfg.enable) {
-		val |= CTC_MARS_WOL_EN;
+static const struct file_operations mars_regs_fops = {
+	.open = mars_regs_open,
+	.read = mars_regs_read,
+	.llseek = default_llseek,
+	.release = mars_regs_release,
+};
 
-		if (wol_cfg.type == MARS_WOL_TYPE_LEVEL) {
-			val &= ~CTC_MARS_WOL_TYPE;
-			val &= ~CTC_MARS_WOL_INTR_SEL;
-		} else if (wol_cfg.type == MARS_WOL_TYPE_PULSE) {
-			val |= CTC_MARS_WOL_TYPE;
-			val |= CTC_MARS_WOL_INTR_SEL;
+enum mars_pkg_pattern_e {
+	MARS_PKG_PATTERN_RANDOM,
+	MARS_PKG_PATTERN_INCREMENT,
+	MARS_PKG_PATTERN_FIXED,
+	MARS_PKG_PATTERN_MAX
+};
 
-			if (wol_cfg.width == MARS_WOL_WIDTH_84MS) {
-				val &= ~CTC_MARS_WOL_WIDTH1;
-				val &= ~CTC_MARS_WOL_WIDTH2;
-			} else if (wol_cfg.width == MARS_WOL_WIDTH_168MS) {
-				val |= CTC_MARS_WOL_WIDTH1;
-				val &= ~CTC_MARS_WOL_WIDTH2;
-			} else if (wol_cfg.width == MARS_WOL_WIDTH_336MS) {
-				val &= ~CTC_MARS_WOL_WIDTH1;
-				val |= CTC_MARS_WOL_WIDTH2;
-			} else if (wol_cfg.width == MARS_WOL_WIDTH_672MS) {
-				val |= CTC_MARS_WOL_WIDTH1;
-				val |= CTC_MARS_WOL_WIDTH2;
-			}
-		}
-	} else {
-		val &= ~CTC_MARS_WOL_EN;
-		val &= ~CTC_MARS_WOL_INTR_SEL;
-	}
+static const char * const mars_pkg_pattern_names[MARS_PKG_PATTERN_MAX] = {
+	[MARS_PKG_PATTERN_RANDOM] = "random",
+	[MARS_PKG_PATTERN_INCREMENT] = "increment",
+	[MARS_PKG_PATTERN_FIXED] = "fixed",
+};
+
+/* The generator sits in the copper checker block and its frames are
+ * counted by the checker, the pkg files only exist with both available.
+ * The enable bit is written last.
+ */
+static int mars_pkg_start(struct phy_device *phydev)
+{
+	struct mars_priv *priv = phydev->priv;
+	struct mars_reg_seq_t seq[] = {
+		MARS_SEQ_EXT(CTC_PHY_REG_SPACE, CTC_MARS_PKG_CFG1_REG, 0xffff,
+			     priv->pkg_len),
+		MARS_SEQ_EXT(CTC_PHY_REG_SPACE, CTC_MARS_PKG_CFG2_REG, 0xffff,
+			     priv->pkg_count),
+		MARS_SEQ_EXT(CTC_PHY_REG_SPACE, CTC_MARS_PKG_CFG0_REG,
+			     CTC_MARS_PKG_GEN_EN | CTC_MARS_PKG_PATTERN_MASK,
+			     CTC_MARS_PKG_GEN_EN |
+			     (priv->pkg_pattern << CTC_MARS_PKG_PATTERN_SHIFT)),
+	};
+
+	if (priv->pkg_len < CTC_MARS_PKG_LEN_MIN ||
+	    priv->pkg_len > CTC_MARS_PKG_LEN_MAX ||
+	    priv->pkg_count > 0xffff ||
+	    priv->pkg_pattern >= MARS_PKG_PATTERN_MAX)
+		return -EINVAL;
+
+	return mars_apply_reg_seq(phydev, seq, ARRAY_SIZE(seq));
+}
+
+static int mars_pkg_stop(struct phy_device *phydev)
+{
+	const struct mars_reg_seq_t step =
+		MARS_SEQ_EXT(CTC_PHY_REG_SPACE, CTC_MARS_PKG_CFG0_REG,
+			     CTC_MARS_PKG_GEN_EN, 0);
+
+	return mars_apply_reg_seq(phydev, &step, 1);
+}
+
+/* State read back from the PHY, settings and the checker counters */
+static int mars_pkg_show(struct seq_file *m, void *v)
+{
+	struct mars_priv *priv = m->private;
+	struct phy_device *phydev = priv->phydev;
+	const struct mars_reg_seq_t step =
+		MARS_SEQ_EXT(CTC_PHY_REG_SPACE, CTC_MARS_PKG_CFG0_REG, 0, 0);
+	u16 cfg0;
+	int ret;
 
-	ret = mars_ext_write(phydev, CTC_MARS_WOL_CFG_REG, val);
+	mutex_lock(&phydev->lock);
+	ret = mars_read_reg_seq(phydev, &step, 1, &cfg0);
+	if (ret >= 0)
+		ret = mars_update_hw_stats(phydev);
+	mutex_unlock(&phydev->lock);
 	if (ret < 0)
 		return ret;
 
+	seq_printf(m, "state %s\n",
+		   cfg0 & CTC_MARS_PKG_GEN_EN ? "running" : "stopped");
+	seq_printf(m, "len %u count %u pattern %s\n", priv->pkg_len,
+		   priv->pkg_count,
+		   priv->pkg_pattern < MARS_PKG_PATTERN_MAX ?
+		   mars_pkg_pattern_names[priv->pkg_pattern] : "invalid");
+	seq_printf(m, "tx_good %llu tx_err %llu rx_good %llu rx_err %llu\n",
+		   priv->stats.tx_good, priv->stats.tx_err,
+		   priv->stats.rx_good, priv->stats.rx_err);
+
 	return 0;
 }
 
-static void mars_get_wol(struct phy_device *phydev, struct ethtool_wolinfo *wol)
+static int mars_pkg_open(struct inode *inode, struct file *file)
 {
-	int val = 0;
+	return single_open(file, mars_pkg_show, inode->i_private);
+}
 
-	wol->supported = WAKE_MAGIC;
-	wol->wolopts = 0;
+/* "start" or "stop", starting stops a running generation first */
+static ssize_t mars_pkg_write(struct file *file, const char __user *ubuf,
+			      size_t len, loff_t *ppos)
+{
+	struct seq_file *m = file->private_data;
+	struct mars_priv *priv = m->private;
+	struct phy_device *phydev = priv->phydev;
+	char cmd[8];
+	int ret;
 
-	val = mars_ext_read(phydev, CTC_MARS_WOL_CFG_REG);
-	if (val < 0)
-		return;
+	if (len >= sizeof(cmd))
+		return -EINVAL;
+	if (copy_from_user(cmd, ubuf, len))
+		return -EFAULT;
+	cmd[len] = '\0';
+
+	mutex_lock(&phydev->lock);
+	if (sysfs_streq(cmd, "start")) {
+		ret = mars_pkg_stop(phydev);
+		if (ret >= 0)
+			ret = mars_pkg_start(phydev);
+	} else if (sysfs_streq(cmd, "stop")) {
+		ret = mars_pkg_stop(phydev);
+	} else {
+		ret = -EINVAL;
+	}
+	mutex_unlock(&phydev->lock);
 
-	if (val & CTC_MARS_WOL_EN)
-		wol->wolopts |= WAKE_MAGIC;
+	return ret < 0 ? ret : len;
 }
 
-static int mars_set_wol(struct phy_device *phydev, struct ethtool_wolinfo *wol)
+static const struct file_operations mars_pkg_fops = {
+	.open = mars_pkg_open,
+	.read = seq_read,
+	.write = mars_pkg_write,
+	.llseek = seq_lseek,
+	.release = single_release,
+};
+
+static void mars_debugfs_init(struct phy_device *phydev)
 {
-	int ret, val;
-	struct mars_wol_cfg_t wol_cfg;
+	struct mars_priv *priv = phydev->priv;
 
-	memset(&wol_cfg, 0, sizeof(struct mars_wol_cfg_t));
+	if (!debugfs && !debugfs_regs)
+		return;
 
-	if (wol->wolopts & WAKE_MAGIC) {
-		/* Enable the WOL interrupt */
-		val =
-		    mars_page_read(phydev, CTC_PHY_REG_SPACE,
-				   CTC_MARS_INTR_REG);
-		val |= CTC_MARS_WOL_INTR;
-		ret =
-		    mars_page_write(phydev, CTC_PHY_REG_SPACE,
-				    CTC_MARS_INTR_REG, val);
-		if (ret < 0)
-			return ret;
+	mutex_lock(&mars_debugfs_lock);
+	if (!mars_debugfs_users++) {
+		mars_debugfs_root = debugfs_create_dir("ctc_mars", NULL);
+		/* A register dump alone doesn't pay for the accounting */
+		if (debugfs)
+			static_branch_enable(&mars_acct_enabled);
+	}
+	mutex_unlock(&mars_debugfs_lock);
+
+	priv->debugfs = debugfs_create_dir(dev_name(mars_dev(phydev)),
+					   mars_debugfs_root);
+	if (debugfs)
+		debugfs_create_file("acct", 0444, priv->debugfs, priv,
+				    &mars_acct_fops);
+	if (debugfs_regs)
+		debugfs_create_file("registers", 0400, priv->debugfs, priv,
+				    &mars_regs_fops);
+	if (priv->port_type == MARS_PORT_TYPE_FIBER || !priv->pkg_chk)
+		return;
 
-		/* Set the WOL config */
-		wol_cfg.enable = CTC_PHY_GLB_ENABLE;
-		wol_cfg.type = MARS_WOL_TYPE_PULSE;
-		wol_cfg.width = MARS_WOL_WIDTH_672MS;
-		ret = mars_wol_en_cfg(phydev, wol_cfg);
-		if (ret < 0)
-			return ret;
+	priv->pkg_len = CTC_MARS_PKG_LEN_MIN;
+	debugfs_create_u32("pkg_len", 0600, priv->debugfs, &priv->pkg_len);
+	debugfs_create_u32("pkg_count", 0600, priv->debugfs, &priv->pkg_count);
+	debugfs_create_u32("pkg_pattern", 0600, priv->debugfs,
+			   &priv->pkg_pattern);
+	debugfs_create_file("pkg", 0600, priv->debugfs, priv, &mars_pkg_fops);
+}
 
-		/* Store the device address for the magic packet */
-		ret = mars_ext_write(phydev, CTC_MARS_MAGIC_PACKET_MAC_ADDR2,
-				     ((phydev->attached_dev->dev_addr[0] << 8) |
-				      phydev->attached_dev->dev_addr[1]));
-		if (ret < 0)
-			return ret;
-		ret = mars_ext_write(phydev, CTC_MARS_MAGIC_PACKET_MAC_ADDR1,
-				     ((phydev->attached_dev->dev_addr[2] << 8) |
-				      phydev->attached_dev->dev_addr[3]));
-		if (ret < 0)
-			return ret;
-		ret = mars_ext_write(phydev, CTC_MARS_MAGIC_PACKET_MAC_ADDR0,
-				     ((phydev->attached_dev->dev_addr[4] << 8) |
-				      phydev->attached_dev->dev_addr[5]));
-		if (ret < 0)
-			return ret;
-	} else {
-		wol_cfg.enable = CTC_PHY_GLB_DISABLE;
-		wol_cfg.type = MARS_WOL_TYPE_MAX;
-		wol_cfg.width = MARS_WOL_WIDTH_MAX;
-		ret = mars_wol_en_cfg(phydev, wol_cfg);
-		if (ret < 0)
-			return ret;
+static void mars_debugfs_exit(struct phy_device *phydev)
+{
+	struct mars_priv *priv = phydev->priv;
+
+	if (!priv->debugfs)
+		return;
+
+	debugfs_remove_recursive(priv->debugfs);
+	priv->debugfs = NULL;
+	/* Don't leave the generator flooding the line */
+	if (priv->port_type != MARS_PORT_TYPE_FIBER && priv->pkg_chk)
+		mars_pkg_stop(phydev);
+
+	mutex_lock(&mars_debugfs_lock);
+	if (!--mars_debugfs_users) {
+		if (debugfs)
+			static_branch_disable(&mars_acct_enabled);
+		debugfs_remove_recursive(mars_debugfs_root);
+		mars_debugfs_root = NULL;
 	}
+	mutex_unlock(&mars_debugfs_lock);
+}
+#else
+static void mars_debugfs_init(struct phy_device *phydev)
+{
+}
 
-	return 0;
+static void mars_debugfs_exit(struct phy_device *phydev)
+{
 }
+#endif
 
-static int mars_get_port_type(struct phy_device *phydev)
+static int mars_probe(struct phy_device *phydev)
 {
-	int val = 0;
-	int port_type = 0;
+	struct mars_priv *priv;
+	int ret;
 
-	val = mars_ext_read(phydev, CTC_MARS_CHIP_CFG_REG);
-	if (val < 0)
-		return val;
-	val &= 0x7;
+	priv = devm_kzalloc(mars_dev(phydev), sizeof(*priv), GFP_KERNEL);
+	if (!priv)
+		return -ENOMEM;
+
+	priv->phydev = phydev;
+	priv->probe_time = ktime_get();
+	priv->reg_space = CTC_REG_SPACE_UNKNOWN;
+	priv->active_medium = MARS_PORT_TYPE_UTP;
+	priv->eee_adv = MARS_SHADOW_UNKNOWN;
+	priv->lpi_timer = MARS_SHADOW_UNKNOWN;
+	priv->fld_cfg = MARS_SHADOW_UNKNOWN;
+	priv->link_timer = MARS_SHADOW_UNKNOWN;
+	priv->smart_speed = MARS_SHADOW_UNKNOWN;
+	priv->loopback_space = CTC_REG_SPACE_UNKNOWN;
+	priv->rx_delay_ps = -1;
+	priv->tx_delay_ps = -1;
+	priv->irq_events = irq_mask & CTC_PHY_IEVENT_LINK_MASK;
+	priv->wolopts = wol_default ? WAKE_MAGIC : 0;
+	priv->pkg_chk = pkg_checker;
+	mars_wol_output(priv, wol_pulse_ms);
+	priv->damp.half_life_ms = MARS_DAMP_HALF_LIFE_MS;
+	priv->damp.suppress = MARS_DAMP_SUPPRESS;
+	priv->damp.reuse = MARS_DAMP_REUSE;
+	priv->damp.stamp = jiffies;
+	INIT_LIST_HEAD(&priv->init_node);
+	spin_lock_init(&priv->irq_lock);
+	INIT_DELAYED_WORK(&priv->irq_work, mars_irq_poll_work);
+	INIT_DELAYED_WORK(&priv->damp_work, mars_damp_work);
+	seqlock_init(&priv->snap_lock);
+	priv->poll_change = jiffies;
+	INIT_DELAYED_WORK(&priv->poll_work, mars_poll_work);
+	phydev->priv = priv;
+	mars_shadow_invalidate(phydev);
+
+	/* The port type is strapped, it won't change until the next probe */
+	ret = mars_get_port_type(phydev);
+	if (ret < 0)
+		return ret;
 
-	if (val == 0x0 || val == 0x3)
-		port_type = MARS_PORT_TYPE_UTP;
-	else if (val == 0x1 || val == 0x4 || val == 0x5)
-		port_type = MARS_PORT_TYPE_FIBER;
-	else
-		port_type = MARS_PORT_TYPE_COMBO;
+	mars_parse_dt(phydev);
+
+	ret = sysfs_create_group(&mars_dev(phydev)->kobj, &mars_attr_group);
+	if (ret < 0)
+		return ret;
 
-    phydev->priv = kzalloc(sizeof(int), GFP_KERNEL);
-	if (!phydev->priv)
-		return -1;
+	/* The rest of the hardware init doesn't hold up the probe */
+	ret = mars_bus_init_queue(phydev);
+	if (ret < 0) {
+		sysfs_remove_group(&mars_dev(phydev)->kobj, &mars_attr_group);
+		return ret;
+	}
 
-	*(int*)phydev->priv = port_type;
+	mars_debugfs_init(phydev);
 
 	return 0;
 }
 
-int mars_config_init(struct phy_device *phydev)
+static void mars_remove(struct phy_device *phydev)
 {
-	int val;
-	u32 features;
-#ifdef CTC_MARS_WOL_ENABLE
-	struct ethtool_wolinfo wol;
-#endif
-#if (LINUX_VERSION_CODE >= KERNEL_VERSION(5, 0, 0))
-	__ETHTOOL_DECLARE_LINK_MODE_MASK(features_linkmode);
-#endif
+	struct mars_priv *priv = phydev->priv;
 
-	mars_set_link_timer_2_6ms(phydev);
+	cancel_delayed_work_sync(&priv->irq_work);
+	cancel_delayed_work_sync(&priv->damp_work);
+	cancel_delayed_work_sync(&priv->poll_work);
+	mars_debugfs_exit(phydev);
+	mars_bus_init_put(phydev);
+	sysfs_remove_group(&mars_dev(phydev)->kobj, &mars_attr_group);
 
-	features = (SUPPORTED_TP | SUPPORTED_MII
-		    | SUPPORTED_AUI | SUPPORTED_FIBRE |
-		    SUPPORTED_BNC | SUPPORTED_Pause | SUPPORTED_Asym_Pause);
+	/* priv itself is released by devm */
+	phydev->priv = NULL;
+}
 
-	/* Do we support autonegotiation? */
-	val = mars_page_read(phydev, CTC_PHY_REG_SPACE, MII_BMSR);
-	if (val < 0)
-		return val;
+static const struct mars_reg_seq_t mars_pm_regs[MARS_PM_REG_MAX] = {
+	[MARS_PM_ADVERTISE] =
+		MARS_SEQ_STD(CTC_PHY_REG_SPACE, MII_ADVERTISE, 0xffff, 0),
+	[MARS_PM_CTRL1000] =
+		MARS_SEQ_STD(CTC_PHY_REG_SPACE, MII_CTRL1000, 0xffff, 0),
+	[MARS_PM_SDS_ADVERTISE] =
+		MARS_SEQ_STD(CTC_SDS_REG_SPACE, MII_ADVERTISE, 0xffff, 0),
+	[MARS_PM_IMASK] =
+		MARS_SEQ_STD(CTC_PHY_REG_SPACE, CTC_PHY_IMASK, 0xffff, 0),
+	[MARS_PM_WOL_CFG] =
+		MARS_SEQ_EXT(CTC_PHY_REG_SPACE, CTC_MARS_WOL_CFG_REG, 0xffff, 0),
+	[MARS_PM_LINK_TIMER] =
+		MARS_SEQ_EXT(CTC_SDS_REG_SPACE, CTC_MARS_SDS_LINK_TIMER_REG,
+			     0xffff, 0),
+	[MARS_PM_FLD_CFG] =
+		MARS_SEQ_EXT(CTC_PHY_REG_SPACE, CTC_MARS_FLD_CFG_REG, 0xffff, 0),
+	[MARS_PM_SMART_SPEED] =
+		MARS_SEQ_EXT(CTC_PHY_REG_SPACE, CTC_MARS_SMART_SPEED_REG,
+			     CTC_MARS_SMART_SPEED_MASK, 0),
+};
 
-	if (val & BMSR_ANEGCAPABLE)
-		features |= SUPPORTED_Autoneg;
+static int mars_suspend(struct phy_device *phydev)
+{
+	struct mars_priv *priv = phydev->priv;
+	int ret;
 
-	if (val & BMSR_100FULL)
-		features |= SUPPORTED_100baseT_Full;
-	if (val & BMSR_100HALF)
-		features |= SUPPORTED_100baseT_Half;
-	if (val & BMSR_10FULL)
-		features |= SUPPORTED_10baseT_Full;
-	if (val & BMSR_10HALF)
-		features |= SUPPORTED_10baseT_Half;
+	/* Without a snapshot resume simply falls back to a full restart */
+	ret = mars_read_reg_seq(phydev, mars_pm_regs, MARS_PM_REG_MAX,
+				priv->pm_regs);
+	priv->pm_valid = (ret >= 0);
 
-	if (val & BMSR_ESTATEN) {
-		val = mars_page_read(phydev, CTC_PHY_REG_SPACE, MII_ESTATUS);
-		if (val < 0)
-			return val;
+	return genphy_suspend(phydev);
+}
 
-		if (val & ESTATUS_1000_TFULL)
-			features |= SUPPORTED_1000baseT_Full;
-		if (val & ESTATUS_1000_THALF)
-			features |= SUPPORTED_1000baseT_Half;
-	}
-#if (LINUX_VERSION_CODE >= KERNEL_VERSION(5, 0, 0))
-	ethtool_convert_legacy_u32_to_link_mode(features_linkmode, features);
-	linkmode_and(phydev->supported, phydev->supported, features_linkmode);
-	linkmode_and(phydev->advertising, phydev->supported, features_linkmode);
-#else
-	phydev->supported &= features;
-	phydev->advertising &= features;
-#endif
-	mars_get_port_type(phydev);
+static int mars_resume(struct phy_device *phydev)
+{
+	struct mars_priv *priv = phydev->priv;
+	struct mars_reg_seq_t seq[MARS_PM_REG_MAX];
+	u16 vals[MARS_PM_REG_MAX];
+	int i, n = 0;
+	int ret;
 
-#ifdef CTC_MARS_WOL_ENABLE
-	wol.wolopts = 0;
-	wol.supported = WAKE_MAGIC;
-	wol.wolopts |= WAKE_MAGIC;
-	mars_set_wol(phydev, &wol);
-#endif
+	/* Register space selection may not survive power down */
+	mars_reg_space_invalidate(phydev);
 
-	return 0;
-}
+	ret = genphy_resume(phydev);
+	if (ret < 0 || !priv->pm_valid)
+		return ret;
+	priv->pm_valid = false;
 
-int mars1p_config_init(struct phy_device *phydev)
-{
-	/*RGMII clock 2.5M when link down, bit12:1->0 */
-	mars_page_ext_write(phydev, CTC_PHY_REG_SPACE, 0xc, 0x8051);
-	/*Disable sleep mode, bit15:1->0 */
-	mars_page_ext_write(phydev, CTC_PHY_REG_SPACE, 0x27, 0x2029);
-	/* disable PHY to respond to MDIO access with PHYAD0 */
-	/* MMD7 8001h: bit6: 0, change value: 0x7f --> 0x3f */
-	mars_page_write(phydev, CTC_PHY_REG_SPACE, 0xd, 0x7);
-	mars_page_write(phydev, CTC_PHY_REG_SPACE, 0xe, 0x8001);
-	mars_page_write(phydev, CTC_PHY_REG_SPACE, 0xd, 0x4007);
-	mars_page_write(phydev, CTC_PHY_REG_SPACE, 0xe, 0x3f);
+	ret = mars_read_reg_seq(phydev, mars_pm_regs, MARS_PM_REG_MAX, vals);
+	if (ret < 0)
+		return ret;
+
+	/* Write back only the registers that lost their value */
+	for (i = 0; i < MARS_PM_REG_MAX; i++) {
+		if (vals[i] == priv->pm_regs[i])
+			continue;
+		seq[n] = mars_pm_regs[i];
+		seq[n].val = priv->pm_regs[i];
+		n++;
+	}
+
+	/* genphy_resume() went behind the BMCR shadows, the advertisement
+	 * shadows still match once the snapshot is written back.
+	 */
+	priv->bmcr[CTC_PHY_REG_SPACE] = MARS_SHADOW_UNKNOWN;
+	priv->bmcr[CTC_SDS_REG_SPACE] = MARS_SHADOW_UNKNOWN;
 
-	return mars_config_init(phydev);
+	return mars_apply_reg_seq(phydev, seq, n);
 }
 
 static struct phy_driver ctc_drivers[] = {
@@ -805,14 +4436,43 @@ static struct phy_driver ctc_drivers[] = {
 	 .phy_id = CTC_PHY_ID_MARS1S,
 	 .phy_id_mask = CTC_PHY_ID_MASK,
 	 .name = "CTC MARS1S",
+#if (LINUX_VERSION_CODE >= KERNEL_VERSION(4, 5, 0))
+	 .mdiodrv.driver.probe_type = PROBE_PREFER_ASYNCHRONOUS,
+#endif
+	 .probe = mars_probe,
+	 .remove = mars_remove,
 	 .config_init = mars_config_init,
 	 .features = PHY_GBIT_FEATURES,
 	 .config_aneg = mars1s_config_aneg,
+#if (LINUX_VERSION_CODE >= KERNEL_VERSION(5, 11, 0))
+	 .handle_interrupt = mars_handle_interrupt,
+#else
 	 .ack_interrupt = &mars_ack_interrupt,
+#endif
 	 .config_intr = &mars_config_intr,
 	 .read_status = &mars_read_status,
-	 .suspend = genphy_suspend,
-	 .resume = genphy_resume,
+	 .suspend = mars_suspend,
+	 .resume = mars_resume,
+#if (LINUX_VERSION_CODE >= KERNEL_VERSION(4, 5, 0))
+	 .get_sset_count = mars_get_sset_count,
+	 .get_strings = mars_get_strings,
+	 .get_stats = mars_get_stats,
+#endif
+#if (LINUX_VERSION_CODE >= KERNEL_VERSION(4, 18, 0))
+	 .read_page = mars_read_page,
+	 .write_page = mars_write_page,
+#endif
+#ifdef MARS_MMD_OPS
+	 .read_mmd = mars_read_mmd,
+	 .write_mmd = mars_write_mmd,
+#endif
+#if (LINUX_VERSION_CODE >= KERNEL_VERSION(4, 11, 0))
+	 .get_tunable = mars_get_tunable,
+	 .set_tunable = mars_set_tunable,
+#endif
+#if (LINUX_VERSION_CODE >= KERNEL_VERSION(4, 14, 0))
+	 .set_loopback = mars_set_loopback,
+#endif
 	 .get_wol = &mars_get_wol,
 	 .set_wol = &mars_set_wol,
 	 },
@@ -820,14 +4480,43 @@ static struct phy_driver ctc_drivers[] = {
 	 .phy_id = CTC_PHY_ID_MARS1S_V1,
 	 .phy_id_mask = CTC_PHY_ID_MASK,
 	 .name = "CTC MARS1S_V1",
+#if (LINUX_VERSION_CODE >= KERNEL_VERSION(4, 5, 0))
+	 .mdiodrv.driver.probe_type = PROBE_PREFER_ASYNCHRONOUS,
+#endif
+	 .probe = mars_probe,
+	 .remove = mars_remove,
 	 .config_init = mars_config_init,
 	 .features = PHY_GBIT_FEATURES,
 	 .config_aneg = mars1s_config_aneg,
+#if (LINUX_VERSION_CODE >= KERNEL_VERSION(5, 11, 0))
+	 .handle_interrupt = mars_handle_interrupt,
+#else
 	 .ack_interrupt = &mars_ack_interrupt,
+#endif
 	 .config_intr = &mars_config_intr,
 	 .read_status = &mars_read_status,
-	 .suspend = genphy_suspend,
-	 .resume = genphy_resume,
+	 .suspend = mars_suspend,
+	 .resume = mars_resume,
+#if (LINUX_VERSION_CODE >= KERNEL_VERSION(4, 5, 0))
+	 .get_sset_count = mars_get_sset_count,
+	 .get_strings = mars_get_strings,
+	 .get_stats = mars_get_stats,
+#endif
+#if (LINUX_VERSION_CODE >= KERNEL_VERSION(4, 18, 0))
+	 .read_page = mars_read_page,
+	 .write_page = mars_write_page,
+#endif
+#ifdef MARS_MMD_OPS
+	 .read_mmd = mars_read_mmd,
+	 .write_mmd = mars_write_mmd,
+#endif
+#if (LINUX_VERSION_CODE >= KERNEL_VERSION(4, 11, 0))
+	 .get_tunable = mars_get_tunable,
+	 .set_tunable = mars_set_tunable,
+#endif
+#if (LINUX_VERSION_CODE >= KERNEL_VERSION(4, 14, 0))
+	 .set_loopback = mars_set_loopback,
+#endif
 	 .get_wol = &mars_get_wol,
 	 .set_wol = &mars_set_wol,
 	 },
@@ -835,30 +4524,90 @@ static struct phy_driver ctc_drivers[] = {
 	 .phy_id = CTC_PHY_ID_MARS1P,
 	 .phy_id_mask = CTC_PHY_ID_MASK,
 	 .name = "CTC MARS1P",
-	 .config_init = mars1p_config_init,
+#if (LINUX_VERSION_CODE >= KERNEL_VERSION(4, 5, 0))
+	 .mdiodrv.driver.probe_type = PROBE_PREFER_ASYNCHRONOUS,
+#endif
+	 .probe = mars_probe,
+	 .remove = mars_remove,
+	 .config_init = mars_config_init,
 	 .features = PHY_GBIT_FEATURES,
 	 .config_aneg = mars1s_config_aneg,
+#if (LINUX_VERSION_CODE >= KERNEL_VERSION(5, 11, 0))
+	 .handle_interrupt = mars_handle_interrupt,
+#else
 	 .ack_interrupt = &mars_ack_interrupt,
+#endif
 	 .config_intr = &mars_config_intr,
-	 .read_status = genphy_read_status,
-	 .suspend = genphy_suspend,
-	 .resume = genphy_resume,
+	 .read_status = mars1p_read_status,
+	 .suspend = mars_suspend,
+	 .resume = mars_resume,
+#if (LINUX_VERSION_CODE >= KERNEL_VERSION(4, 5, 0))
+	 .get_sset_count = mars_get_sset_count,
+	 .get_strings = mars_get_strings,
+	 .get_stats = mars_get_stats,
+#endif
+#if (LINUX_VERSION_CODE >= KERNEL_VERSION(4, 18, 0))
+	 .read_page = mars_read_page,
+	 .write_page = mars_write_page,
+#endif
+#ifdef MARS_MMD_OPS
+	 .read_mmd = mars_read_mmd,
+	 .write_mmd = mars_write_mmd,
+#endif
+#if (LINUX_VERSION_CODE >= KERNEL_VERSION(4, 11, 0))
+	 .get_tunable = mars_get_tunable,
+	 .set_tunable = mars_set_tunable,
+#endif
+#if (LINUX_VERSION_CODE >= KERNEL_VERSION(4, 14, 0))
+	 .set_loopback = mars_set_loopback,
+#endif
 	 },
 	{
 	 .phy_id = CTC_PHY_ID_MARS1P_V1,
 	 .phy_id_mask = CTC_PHY_ID_MASK,
 	 .name = "CTC MARS1P_V1",
-	 .config_init = mars1p_config_init,
+#if (LINUX_VERSION_CODE >= KERNEL_VERSION(4, 5, 0))
+	 .mdiodrv.driver.probe_type = PROBE_PREFER_ASYNCHRONOUS,
+#endif
+	 .probe = mars_probe,
+	 .remove = mars_remove,
+	 .config_init = mars_config_init,
 	 .features = PHY_GBIT_FEATURES,
 	 .config_aneg = mars1s_config_aneg,
+#if (LINUX_VERSION_CODE >= KERNEL_VERSION(5, 11, 0))
+	 .handle_interrupt = mars_handle_interrupt,
+#else
 	 .ack_interrupt = &mars_ack_interrupt,
+#endif
 	 .config_intr = &mars_config_intr,
-	 .read_status = genphy_read_status,
-	 .suspend = genphy_suspend,
-	 .resume = genphy_resume,
+	 .read_status = mars1p_read_status,
+	 .suspend = mars_suspend,
+	 .resume = mars_resume,
+#if (LINUX_VERSION_CODE >= KERNEL_VERSION(4, 5, 0))
+	 .get_sset_count = mars_get_sset_count,
+	 .get_strings = mars_get_strings,
+	 .get_stats = mars_get_stats,
+#endif
+#if (LINUX_VERSION_CODE >= KERNEL_VERSION(4, 18, 0))
+	 .read_page = mars_read_page,
+	 .write_page = mars_write_page,
+#endif
+#ifdef MARS_MMD_OPS
+	 .read_mmd = mars_read_mmd,
+	 .write_mmd = mars_write_mmd,
+#endif
+#if (LINUX_VERSION_CODE >= KERNEL_VERSION(4, 11, 0))
+	 .get_tunable = mars_get_tunable,
+	 .set_tunable = mars_set_tunable,
+#endif
+#if (LINUX_VERSION_CODE >= KERNEL_VERSION(4, 14, 0))
+	 .set_loopback = mars_set_loopback,
+#endif
 	 },
 };
 
+/* The KUnit module drives ctc_drivers[] itself and must not bind PHYs */
+#ifndef MARS_KUNIT
 #if (LINUX_VERSION_CODE >= KERNEL_VERSION(3, 19, 0))
 module_phy_driver(ctc_drivers);
 #else
@@ -889,3 +4638,4 @@ MODULE_DEVICE_TABLE(mdio, mars_tbl);
 MODULE_DESCRIPTION("Driver for Centec PHYs");
 MODULE_AUTHOR("liuht <liuht@centecnetworks.com>");
 MODULE_LICENSE("GPL v2");
+#endif
@@ -0,0 +1,576 @@
+// SPDX-License-Identifier: GPL-2.0
+
+/* KUnit tests of the Centec MARS PHY driver MDIO frame counts
+ *
+ * Copyright 2002-2021, Centec Networks (Suzhou) Co., Ltd.
+ *
+ * The driver is built into this module against a fake MDIO bus emulating
+ * the std, extended and SerDes register spaces, for each driver entry and
+ * each CHIP_CFG port configuration. Every callback is checked to issue the
+ * exact number of frames in mars_test_frames[], the frame budget of the
+ * driver: a change that costs bus traffic has to update the table.
+ */
+
+/* mars.c is included, keep its tracepoints and driver registration out */
+#define NOTRACE
+#define MARS_KUNIT
+#include "mars.c"
+
+#include <kunit/test.h>
+
+#if (LINUX_VERSION_CODE >= KERNEL_VERSION(5, 10, 0))
+
+#define MARS_FAKE_ADDR		1
+/* Extended registers below 0xa000 are per register space, the 0xa0xx
+ * block (page selector, chip config) is common to both
+ */
+#define MARS_FAKE_EXT_REGS	0x100
+#define MARS_FAKE_COMMON_REG	0xa000
+#define MARS_FAKE_MMD_REGS	16
+#define MARS_FAKE_CHIP_CFGS	8
+
+struct mars_fake_mmd_t {
+	/* 0 when the entry is free */
+	int devad;
+	u16 reg;
+	u16 val;
+};
+
+struct mars_fake_t {
+	u16 std[2][32];
+	u16 ext[2][MARS_FAKE_EXT_REGS];
+	u16 common[MARS_FAKE_EXT_REGS];
+	/* Extended register, ext registers out of the emulated range */
+	u16 ext_addr;
+	u16 ext_dummy;
+	/* MMD access through the UTP space MII_MMD_CTRL/MII_MMD_DATA */
+	u16 mmd_ctrl;
+	u16 mmd_addr;
+	u16 mmd_dummy;
+	struct mars_fake_mmd_t mmd[MARS_FAKE_MMD_REGS];
+	unsigned int frames;
+};
+
+static int mars_fake_space(struct mars_fake_t *fake)
+{
+	return (fake->common[CTC_MARS_PAGE_REG - MARS_FAKE_COMMON_REG] & 0x2) ?
+		CTC_SDS_REG_SPACE : CTC_PHY_REG_SPACE;
+}
+
+static u16 *mars_fake_ext(struct mars_fake_t *fake)
+{
+	u16 reg = fake->ext_addr;
+
+	if (reg >= MARS_FAKE_COMMON_REG &&
+	    reg < MARS_FAKE_COMMON_REG + MARS_FAKE_EXT_REGS)
+		return &fake->common[reg - MARS_FAKE_COMMON_REG];
+	if (reg < MARS_FAKE_EXT_REGS)
+		return &fake->ext[mars_fake_space(fake)][reg];
+
+	fake->ext_dummy = 0;
+	return &fake->ext_dummy;
+}
+
+static u16 *mars_fake_mmd(struct mars_fake_t *fake)
+{
+	int devad = fake->mmd_ctrl & MII_MMD_CTRL_DEVAD_MASK;
+	struct mars_fake_mmd_t *free = NULL;
+	int i;
+
+	for (i = 0; i < MARS_FAKE_MMD_REGS; i++) {
+		if (fake->mmd[i].devad == devad &&
+		    fake->mmd[i].reg == fake->mmd_addr)
+			return &fake->mmd[i].val;
+		if (!fake->mmd[i].devad && !free)
+			free = &fake->mmd[i];
+	}
+
+	if (!free) {
+		fake->mmd_dummy = 0;
+		return &fake->mmd_dummy;
+	}
+	free->devad = devad;
+	free->reg = fake->mmd_addr;
+	free->val = 0;
+
+	return &free->val;
+}
+
+static int mars_fake_read(struct mii_bus *bus, int addr, int regnum)
+{
+	struct mars_fake_t *fake = bus->priv;
+	int space = mars_fake_space(fake);
+	u16 mode = fake->mmd_ctrl & ~MII_MMD_CTRL_DEVAD_MASK;
+	u16 val;
+
+	fake->frames++;
+	if (addr != MARS_FAKE_ADDR)
+		return 0xffff;
+
+	if (regnum == 0x1e)
+		return fake->ext_addr;
+	if (regnum == 0x1f)
+		return *mars_fake_ext(fake);
+
+	if (space == CTC_PHY_REG_SPACE && regnum == MII_MMD_DATA) {
+		if (!mode)
+			return fake->mmd_addr;
+		val = *mars_fake_mmd(fake);
+		if (mode == MII_MMD_CTRL_INCR_RDWT)
+			fake->mmd_addr++;
+		return val;
+	}
+
+	val = fake->std[space][regnum];
+	/* Latched events clear on read */
+	if (regnum == CTC_PHY_IEVENT)
+		fake->std[space][regnum] = 0;
+
+	return val;
+}
+
+static int mars_fake_write(struct mii_bus *bus, int addr, int regnum, u16 val)
+{
+	struct mars_fake_t *fake = bus->priv;
+	int space = mars_fake_space(fake);
+	u16 mode = fake->mmd_ctrl & ~MII_MMD_CTRL_DEVAD_MASK;
+
+	fake->frames++;
+	if (addr != MARS_FAKE_ADDR)
+		return 0;
+
+	if (regnum == 0x1e) {
+		fake->ext_addr = val;
+		return 0;
+	}
+	if (regnum == 0x1f) {
+		*mars_fake_ext(fake) = val;
+		return 0;
+	}
+
+	if (space == CTC_PHY_REG_SPACE && regnum == MII_MMD_CTRL) {
+		fake->mmd_ctrl = val;
+		return 0;
+	}
+	if (space == CTC_PHY_REG_SPACE && regnum == MII_MMD_DATA) {
+		if (!mode) {
+			fake->mmd_addr = val;
+			return 0;
+		}
+		*mars_fake_mmd(fake) = val;
+		if (mode != MII_MMD_CTRL_NOINCR)
+			fake->mmd_addr++;
+		return 0;
+	}
+
+	switch (regnum) {
+	case MII_BMSR:
+	case MII_PHYSID1:
+	case MII_PHYSID2:
+	case MII_LPA:
+	case MII_STAT1000:
+	case MII_ESTATUS:
+	case CTC_MARS_SSREG:
+	case CTC_PHY_IEVENT:
+		/* Read only */
+		return 0;
+	case MII_BMCR:
+		/* Reset and restart complete at once */
+		val &= ~(BMCR_RESET | BMCR_ANRESTART);
+		break;
+	}
+	fake->std[space][regnum] = val;
+
+	return 0;
+}
+
+static void mars_fake_link(struct mars_fake_t *fake, bool up)
+{
+	int space;
+
+	for (space = CTC_PHY_REG_SPACE; space <= CTC_SDS_REG_SPACE; space++) {
+		u16 *std = fake->std[space];
+
+		std[MII_BMSR] &= ~(BMSR_LSTATUS | BMSR_ANEGCOMPLETE);
+		std[MII_LPA] = 0;
+		std[MII_STAT1000] = 0;
+		std[CTC_MARS_SSREG] = 0;
+		std[CTC_PHY_IEVENT] |= up ? CTC_PHY_IEVENT_LINK_UP :
+			CTC_PHY_IEVENT_LINK_DOWN;
+		if (!up)
+			continue;
+
+		/* 1000M full duplex with the link partner */
+		std[MII_BMSR] |= BMSR_LSTATUS | BMSR_ANEGCOMPLETE;
+		std[MII_LPA] = (space == CTC_PHY_REG_SPACE) ?
+			LPA_LPACK | ADVERTISE_ALL | ADVERTISE_CSMA :
+			LPA_LPACK | ADVERTISE_1000XFULL;
+		if (space == CTC_PHY_REG_SPACE)
+			std[MII_STAT1000] = LPA_1000LOCALRXOK |
+				LPA_1000REMRXOK | LPA_1000FULL;
+		std[CTC_MARS_SSREG] = CTC_MARS_SSREG_SPEED_1000 |
+			CTC_MARS_SSREG_DUPLEX_FULL | CTC_MARS_SSREG_RESOLVED |
+			CTC_MARS_SSREG_LINK;
+	}
+}
+
+/* Power on state, the strapped chip config and the frame count survive */
+static void mars_fake_reset(struct mars_fake_t *fake, u32 phy_id)
+{
+	u16 chip_cfg = fake->common[CTC_MARS_CHIP_CFG_REG -
+				    MARS_FAKE_COMMON_REG];
+	unsigned int frames = fake->frames;
+	int space;
+
+	memset(fake, 0, sizeof(*fake));
+	fake->common[CTC_MARS_CHIP_CFG_REG - MARS_FAKE_COMMON_REG] = chip_cfg;
+	fake->frames = frames;
+
+	for (space = CTC_PHY_REG_SPACE; space <= CTC_SDS_REG_SPACE; space++) {
+		u16 *std = fake->std[space];
+
+		std[MII_BMCR] = BMCR_ANENABLE | BMCR_FULLDPLX | BMCR_SPEED1000;
+		std[MII_PHYSID1] = phy_id >> 16;
+		std[MII_PHYSID2] = phy_id & 0xffff;
+	}
+	fake->std[CTC_PHY_REG_SPACE][MII_BMSR] = BMSR_100FULL | BMSR_100HALF |
+		BMSR_10FULL | BMSR_10HALF | BMSR_ESTATEN | BMSR_ANEGCAPABLE |
+		BMSR_ERCAP;
+	fake->std[CTC_PHY_REG_SPACE][MII_ADVERTISE] = ADVERTISE_ALL |
+		ADVERTISE_CSMA;
+	fake->std[CTC_PHY_REG_SPACE][MII_CTRL1000] = ADVERTISE_1000FULL;
+	fake->std[CTC_PHY_REG_SPACE][MII_ESTATUS] = ESTATUS_1000_TFULL |
+		ESTATUS_1000_THALF;
+	fake->std[CTC_SDS_REG_SPACE][MII_BMSR] = BMSR_ESTATEN |
+		BMSR_ANEGCAPABLE | BMSR_ERCAP;
+	fake->std[CTC_SDS_REG_SPACE][MII_ADVERTISE] = ADVERTISE_1000XFULL;
+	fake->std[CTC_SDS_REG_SPACE][MII_ESTATUS] = ESTATUS_1000_XFULL;
+}
+
+/* Callback sequence run on every driver entry and chip config */
+enum mars_test_step_e {
+	/* .probe and the deferred init it queues */
+	MARS_STEP_PROBE,
+	/* .config_init after the deferred init, nothing was reset */
+	MARS_STEP_CONFIG_INIT,
+	MARS_STEP_CONFIG_ANEG,
+	/* .read_status on a link up, on the same link again, on a link down */
+	MARS_STEP_LINK_UP,
+	MARS_STEP_LINK_STABLE,
+	MARS_STEP_LINK_DOWN,
+	/* .read_mmd of one register, then of the same one again */
+	MARS_STEP_READ_MMD,
+	MARS_STEP_READ_MMD_AGAIN,
+	MARS_STEP_SET_WOL,
+	MARS_STEP_GET_WOL,
+	/* .config_init after a PHY reset, the whole init is redone */
+	MARS_STEP_CONFIG_INIT_RESET,
+	MARS_STEP_MAX
+};
+
+static const char * const mars_test_step_names[MARS_STEP_MAX] = {
+	[MARS_STEP_PROBE] = "probe",
+	[MARS_STEP_CONFIG_INIT] = "config_init",
+	[MARS_STEP_CONFIG_ANEG] = "config_aneg",
+	[MARS_STEP_LINK_UP] = "read_status link up",
+	[MARS_STEP_LINK_STABLE] = "read_status link stable",
+	[MARS_STEP_LINK_DOWN] = "read_status link down",
+	[MARS_STEP_READ_MMD] = "read_mmd",
+	[MARS_STEP_READ_MMD_AGAIN] = "read_mmd again",
+	[MARS_STEP_SET_WOL] = "set_wol",
+	[MARS_STEP_GET_WOL] = "get_wol",
+	[MARS_STEP_CONFIG_INIT_RESET] = "config_init after reset",
+};
+
+/* Exact frames of each step by chip (MARS1S, MARS1P) and port type, in
+ * the order of enum mars_test_step_e. MARS1P has no WOL callbacks.
+ */
+static const unsigned int
+mars_test_frames[2][MARS_PORT_TYPE_MAX][MARS_STEP_MAX] = {
+	{
+		[MARS_PORT_TYPE_UTP] =   { 15, 11,  6, 2, 2, 1, 4, 1, 2, 0, 12 },
+		[MARS_PORT_TYPE_FIBER] = { 15, 11,  3, 2, 2, 1, 8, 5, 6, 0, 12 },
+		[MARS_PORT_TYPE_COMBO] = { 15, 11, 11, 2, 2, 6, 4, 1, 2, 0, 12 },
+	},
+	{
+		[MARS_PORT_TYPE_UTP] =   { 26, 19,  6, 3, 3, 1, 4, 1, 0, 0, 23 },
+		[MARS_PORT_TYPE_FIBER] = { 26, 19,  3, 5, 3, 1, 4, 1, 0, 0, 23 },
+		[MARS_PORT_TYPE_COMBO] = { 26, 19, 11, 3, 3, 1, 4, 1, 0, 0, 23 },
+	},
+};
+
+/* Port type a CHIP_CFG mode straps, as decoded by mars_get_port_type() */
+static const int mars_test_port_types[MARS_FAKE_CHIP_CFGS] = {
+	MARS_PORT_TYPE_UTP, MARS_PORT_TYPE_FIBER, MARS_PORT_TYPE_COMBO,
+	MARS_PORT_TYPE_UTP, MARS_PORT_TYPE_FIBER, MARS_PORT_TYPE_FIBER,
+	MARS_PORT_TYPE_COMBO, MARS_PORT_TYPE_COMBO,
+};
+
+struct mars_test_ctx_t {
+	struct mii_bus *bus;
+	struct mars_fake_t fake;
+};
+
+static int mars_test_init(struct kunit *test)
+{
+	struct mars_test_ctx_t *ctx;
+	struct mii_bus *bus;
+	int ret;
+
+	ctx = kunit_kzalloc(test, sizeof(*ctx), GFP_KERNEL);
+	if (!ctx)
+		return -ENOMEM;
+
+	bus = mdiobus_alloc();
+	if (!bus)
+		return -ENOMEM;
+	bus->name = "mars-kunit";
+	snprintf(bus->id, MII_BUS_ID_SIZE, "mars-kunit-%p", ctx);
+	bus->read = mars_fake_read;
+	bus->write = mars_fake_write;
+	bus->priv = &ctx->fake;
+	/* The PHY is created by the test, the bus must not probe for one */
+	bus->phy_mask = ~0;
+
+	ret = mdiobus_register(bus);
+	if (ret < 0) {
+		mdiobus_free(bus);
+		return ret;
+	}
+
+	ctx->bus = bus;
+	test->priv = ctx;
+
+	return 0;
+}
+
+static void mars_test_exit(struct kunit *test)
+{
+	struct mars_test_ctx_t *ctx = test->priv;
+
+	mdiobus_unregister(ctx->bus);
+	mdiobus_free(ctx->bus);
+}
+
+/* Create a PHY bound to drv by hand and run .probe on it. The device gets
+ * an id no driver matches so that only the test drives it.
+ */
+static struct phy_device *mars_test_probe(struct kunit *test,
+					  struct phy_driver *drv)
+{
+	struct mars_test_ctx_t *ctx = test->priv;
+	struct phy_device *phydev;
+	struct mars_priv *priv;
+	int ret;
+
+	phydev = phy_device_create(ctx->bus, MARS_FAKE_ADDR, 0, false, NULL);
+	KUNIT_ASSERT_FALSE(test, IS_ERR(phydev));
+
+	ret = phy_device_register(phydev);
+	if (ret < 0) {
+		phy_device_free(phydev);
+		KUNIT_ASSERT_EQ(test, ret, 0);
+	}
+
+	phydev->phy_id = drv->phy_id;
+	phydev->drv = drv;
+	linkmode_copy(phydev->supported, drv->features);
+	linkmode_copy(phydev->advertising, phydev->supported);
+
+	ret = drv->probe(phydev);
+	if (ret < 0) {
+		phy_device_remove(phydev);
+		phy_device_free(phydev);
+		KUNIT_ASSERT_EQ(test, ret, 0);
+	}
+
+	/* Let the deferred init finish, it is part of the probe cost */
+	priv = phydev->priv;
+	flush_work(&priv->bus_init->work);
+
+	return phydev;
+}
+
+static void mars_test_remove(struct phy_device *phydev)
+{
+	phydev->drv->remove(phydev);
+	/* A fast poll may have kicked the state machine */
+	cancel_delayed_work_sync(&phydev->state_queue);
+	phy_device_remove(phydev);
+	phy_device_free(phydev);
+}
+
+/* Run the callback sequence on drv with chip config cfg, frames[] gets
+ * the frames issued by each step
+ */
+static void mars_test_run(struct kunit *test, struct phy_driver *drv,
+			  int cfg, unsigned int *frames)
+{
+	struct mars_test_ctx_t *ctx = test->priv;
+	struct mars_fake_t *fake = &ctx->fake;
+	struct ethtool_wolinfo wol = { .cmd = ETHTOOL_SWOL };
+	struct phy_device *phydev;
+	unsigned int last;
+	int step;
+
+	memset(fake, 0, sizeof(*fake));
+	fake->common[CTC_MARS_CHIP_CFG_REG - MARS_FAKE_COMMON_REG] = cfg;
+	mars_fake_reset(fake, drv->phy_id);
+
+	phydev = mars_test_probe(test, drv);
+	frames[MARS_STEP_PROBE] = fake->frames;
+
+	for (step = MARS_STEP_PROBE + 1; step < MARS_STEP_MAX; step++) {
+		last = fake->frames;
+
+		switch (step) {
+		case MARS_STEP_CONFIG_INIT:
+		case MARS_STEP_CONFIG_INIT_RESET:
+			KUNIT_EXPECT_EQ(test, drv->config_init(phydev), 0);
+			break;
+		case MARS_STEP_CONFIG_ANEG:
+			KUNIT_EXPECT_EQ(test, drv->config_aneg(phydev), 0);
+			break;
+		case MARS_STEP_LINK_UP:
+		case MARS_STEP_LINK_STABLE:
+		case MARS_STEP_LINK_DOWN:
+			KUNIT_EXPECT_EQ(test, drv->read_status(phydev), 0);
+			KUNIT_EXPECT_EQ(test, !!phydev->link,
+					step != MARS_STEP_LINK_DOWN);
+			break;
+		/* phylib holds the bus lock across .read_mmd */
+		case MARS_STEP_READ_MMD:
+		case MARS_STEP_READ_MMD_AGAIN:
+			phy_lock_mdio_bus(phydev);
+			KUNIT_EXPECT_GE(test, drv->read_mmd(phydev, MDIO_MMD_AN,
+							    MDIO_AN_EEE_ADV), 0);
+			phy_unlock_mdio_bus(phydev);
+			break;
+		/* Only MARS1S wires up WOL */
+		case MARS_STEP_SET_WOL:
+			wol.wolopts = 0;
+			if (drv->set_wol)
+				KUNIT_EXPECT_EQ(test,
+						drv->set_wol(phydev, &wol), 0);
+			break;
+		case MARS_STEP_GET_WOL:
+			if (drv->get_wol)
+				drv->get_wol(phydev, &wol);
+			break;
+		}
+		frames[step] = fake->frames - last;
+
+		/* Set up the state the next step runs in, not accounted */
+		if (step == MARS_STEP_CONFIG_ANEG)
+			mars_fake_link(fake, true);
+		else if (step == MARS_STEP_LINK_STABLE)
+			mars_fake_link(fake, false);
+		else if (step == MARS_STEP_GET_WOL)
+			mars_fake_reset(fake, drv->phy_id);
+	}
+
+	mars_test_remove(phydev);
+}
+
+static void mars_test_check(struct kunit *test, int step_first,
+			    int step_last)
+{
+	unsigned int frames[MARS_STEP_MAX];
+	int i, cfg, step, chip, port_type;
+	struct phy_driver *drv;
+
+	for (i = 0; i < ARRAY_SIZE(ctc_drivers); i++) {
+		drv = &ctc_drivers[i];
+		chip = (drv->read_status == mars1p_read_status);
+
+		for (cfg = 0; cfg < MARS_FAKE_CHIP_CFGS; cfg++) {
+			port_type = mars_test_port_types[cfg];
+			mars_test_run(test, drv, cfg, frames);
+
+			for (step = step_first; step <= step_last; step++) {
+				KUNIT_EXPECT_EQ_MSG(test, frames[step],
+					mars_test_frames[chip][port_type][step],
+					"%s chip cfg %d: %s", drv->name, cfg,
+					mars_test_step_names[step]);
+			}
+		}
+	}
+}
+
+static void mars_test_port_type(struct kunit *test)
+{
+	struct mars_test_ctx_t *ctx = test->priv;
+	struct phy_device *phydev;
+	struct mars_priv *priv;
+	int cfg;
+
+	for (cfg = 0; cfg < MARS_FAKE_CHIP_CFGS; cfg++) {
+		memset(&ctx->fake, 0, sizeof(ctx->fake));
+		ctx->fake.common[CTC_MARS_CHIP_CFG_REG -
+				 MARS_FAKE_COMMON_REG] = cfg;
+		mars_fake_reset(&ctx->fake, ctc_drivers[0].phy_id);
+
+		phydev = mars_test_probe(test, &ctc_drivers[0]);
+		priv = phydev->priv;
+		KUNIT_EXPECT_EQ_MSG(test, priv->port_type,
+				    mars_test_port_types[cfg],
+				    "chip cfg %d", cfg);
+		mars_test_remove(phydev);
+	}
+}
+
+static void mars_test_probe_frames(struct kunit *test)
+{
+	mars_test_check(test, MARS_STEP_PROBE, MARS_STEP_PROBE);
+}
+
+static void mars_test_config_init(struct kunit *test)
+{
+	mars_test_check(test, MARS_STEP_CONFIG_INIT, MARS_STEP_CONFIG_INIT);
+	mars_test_check(test, MARS_STEP_CONFIG_INIT_RESET,
+			MARS_STEP_CONFIG_INIT_RESET);
+}
+
+static void mars_test_config_aneg(struct kunit *test)
+{
+	mars_test_check(test, MARS_STEP_CONFIG_ANEG, MARS_STEP_CONFIG_ANEG);
+}
+
+static void mars_test_read_status(struct kunit *test)
+{
+	mars_test_check(test, MARS_STEP_LINK_UP, MARS_STEP_LINK_DOWN);
+}
+
+static void mars_test_read_mmd(struct kunit *test)
+{
+	mars_test_check(test, MARS_STEP_READ_MMD, MARS_STEP_READ_MMD_AGAIN);
+}
+
+static void mars_test_wol(struct kunit *test)
+{
+	mars_test_check(test, MARS_STEP_SET_WOL, MARS_STEP_GET_WOL);
+}
+
+static struct kunit_case mars_test_cases[] = {
+	KUNIT_CASE(mars_test_port_type),
+	KUNIT_CASE(mars_test_probe_frames),
+	KUNIT_CASE(mars_test_config_init),
+	KUNIT_CASE(mars_test_config_aneg),
+	KUNIT_CASE(mars_test_read_status),
+	KUNIT_CASE(mars_test_read_mmd),
+	KUNIT_CASE(mars_test_wol),
+	{}
+};
+
+static struct kunit_suite mars_test_suite = {
+	.name = "mars",
+	.init = mars_test_init,
+	.exit = mars_test_exit,
+	.test_cases = mars_test_cases,
+};
+
+kunit_test_suite(mars_test_suite);
+#endif
+
+MODULE_DESCRIPTION("KUnit tests for the Centec PHY driver");
+MODULE_LICENSE("GPL v2");
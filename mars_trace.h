@@ -0,0 +1,141 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+
+/* Trace events of the Centec MARS PHY driver, included by mars.c once its
+ * enums and compat helpers are defined.
+ *
+ * Copyright 2002-2021, Centec Networks (Suzhou) Co., Ltd.
+ */
+
+#undef TRACE_SYSTEM
+#define TRACE_SYSTEM mars
+
+#if !defined(_MARS_TRACE_H) || defined(TRACE_HEADER_MULTI_READ)
+#define _MARS_TRACE_H
+
+#include <linux/tracepoint.h>
+
+TRACE_DEFINE_ENUM(MARS_FRAME_STD);
+TRACE_DEFINE_ENUM(MARS_FRAME_EXT);
+TRACE_DEFINE_ENUM(MARS_FRAME_PAGE);
+TRACE_DEFINE_ENUM(MARS_PORT_TYPE_UTP);
+TRACE_DEFINE_ENUM(MARS_PORT_TYPE_FIBER);
+
+#define MARS_TRACE_DEV_LEN	32
+
+#define show_mars_frame(kind)					\
+	__print_symbolic(kind,					\
+			 { MARS_FRAME_STD, "std" },		\
+			 { MARS_FRAME_EXT, "ext" },		\
+			 { MARS_FRAME_PAGE, "page" })
+
+#define show_mars_medium(medium)				\
+	__print_symbolic(medium,				\
+			 { MARS_PORT_TYPE_UTP, "copper" },	\
+			 { MARS_PORT_TYPE_FIBER, "fiber" })
+
+/* One register access, start is the ktime_get_ns() before it or 0 */
+DECLARE_EVENT_CLASS(mars_reg,
+	TP_PROTO(struct phy_device *phydev, int kind, int space, u32 reg,
+		 int val, u64 start),
+	TP_ARGS(phydev, kind, space, reg, val, start),
+	TP_STRUCT__entry(
+		__array(char, dev, MARS_TRACE_DEV_LEN)
+		__field(int, kind)
+		__field(int, space)
+		__field(u32, reg)
+		__field(int, val)
+		__field(u64, ns)
+	),
+	TP_fast_assign(
+		strscpy(__entry->dev, dev_name(mars_dev(phydev)),
+			MARS_TRACE_DEV_LEN);
+		__entry->kind = kind;
+		__entry->space = space;
+		__entry->reg = reg;
+		__entry->val = val;
+		/* 0 when the event was enabled during the access */
+		__entry->ns = start ? ktime_get_ns() - start : 0;
+	),
+	TP_printk("%s %s space %d reg 0x%04x val 0x%04x (%d) %llu ns",
+		  __entry->dev, show_mars_frame(__entry->kind),
+		  __entry->space, __entry->reg, __entry->val & 0xffff,
+		  __entry->val, __entry->ns)
+);
+
+DEFINE_EVENT(mars_reg, mars_reg_read,
+	TP_PROTO(struct phy_device *phydev, int kind, int space, u32 reg,
+		 int val, u64 start),
+	TP_ARGS(phydev, kind, space, reg, val, start)
+);
+
+DEFINE_EVENT(mars_reg, mars_reg_write,
+	TP_PROTO(struct phy_device *phydev, int kind, int space, u32 reg,
+		 int val, u64 start),
+	TP_ARGS(phydev, kind, space, reg, val, start)
+);
+
+/* Medium and CTC_MARS_SSREG picked by a status read */
+TRACE_EVENT(mars_link,
+	TP_PROTO(struct phy_device *phydev, int medium, int ssreg, int link),
+	TP_ARGS(phydev, medium, ssreg, link),
+	TP_STRUCT__entry(
+		__array(char, dev, MARS_TRACE_DEV_LEN)
+		__field(int, medium)
+		__field(int, ssreg)
+		__field(int, link)
+	),
+	TP_fast_assign(
+		strscpy(__entry->dev, dev_name(mars_dev(phydev)),
+			MARS_TRACE_DEV_LEN);
+		__entry->medium = medium;
+		__entry->ssreg = ssreg;
+		__entry->link = link;
+	),
+	TP_printk("%s medium %s ssreg 0x%04x link %d", __entry->dev,
+		  show_mars_medium(__entry->medium), __entry->ssreg,
+		  __entry->link)
+);
+
+/* Autonegotiation restart, spaces is a mask of BIT(register space) */
+TRACE_EVENT(mars_aneg_restart,
+	TP_PROTO(struct phy_device *phydev, unsigned int spaces),
+	TP_ARGS(phydev, spaces),
+	TP_STRUCT__entry(
+		__array(char, dev, MARS_TRACE_DEV_LEN)
+		__field(unsigned int, spaces)
+	),
+	TP_fast_assign(
+		strscpy(__entry->dev, dev_name(mars_dev(phydev)),
+			MARS_TRACE_DEV_LEN);
+		__entry->spaces = spaces;
+	),
+	TP_printk("%s spaces 0x%x", __entry->dev, __entry->spaces)
+);
+
+/* Decoded interrupt, status is CTC_PHY_IEVENT */
+TRACE_EVENT(mars_irq,
+	TP_PROTO(struct phy_device *phydev, int status, bool throttled),
+	TP_ARGS(phydev, status, throttled),
+	TP_STRUCT__entry(
+		__array(char, dev, MARS_TRACE_DEV_LEN)
+		__field(int, status)
+		__field(bool, throttled)
+	),
+	TP_fast_assign(
+		strscpy(__entry->dev, dev_name(mars_dev(phydev)),
+			MARS_TRACE_DEV_LEN);
+		__entry->status = status;
+		__entry->throttled = throttled;
+	),
+	TP_printk("%s ievent 0x%04x throttled %d", __entry->dev,
+		  __entry->status, __entry->throttled)
+);
+
+#endif /* _MARS_TRACE_H */
+
+/* Out of tree: the Makefile adds the module directory to the include path */
+#undef TRACE_INCLUDE_PATH
+#define TRACE_INCLUDE_PATH .
+#undef TRACE_INCLUDE_FILE
+#define TRACE_INCLUDE_FILE mars_trace
+#include <trace/define_trace.h>